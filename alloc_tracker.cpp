@@ -0,0 +1,160 @@
+// Replaces the global operator new and delete with counting versions. Linked
+// only into binaries that ask for tracking, see alloc_tracker.h.
+
+#include "alloc_tracker.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+namespace {
+
+constexpr size_t max_tags = 64;
+
+// Plain counters, so that the first allocation of a thread doesn't have to
+// construct anything.
+thread_local AllocCount t_allocs;
+
+std::mutex tags_mutex;
+AllocTag tags[max_tags];
+size_t tag_count = 0;
+
+void *counted(size_t size) {
+  t_allocs.count += 1;
+  t_allocs.bytes += size;
+  return std::malloc(size == 0 ? 1 : size);
+}
+
+void *counted_aligned(size_t size, std::align_val_t align) {
+  t_allocs.count += 1;
+  t_allocs.bytes += size;
+  auto a = static_cast<size_t>(align);
+#ifdef _WIN32
+  return _aligned_malloc(size == 0 ? 1 : size, a);
+#else
+  // aligned_alloc() wants a size that is a multiple of the alignment.
+  return std::aligned_alloc(a, (std::max<size_t>(size, 1) + a - 1) / a * a);
+#endif
+}
+
+void free_aligned(void *p) {
+#ifdef _WIN32
+  _aligned_free(p);
+#else
+  std::free(p);
+#endif
+}
+
+} // namespace
+
+void *operator new(size_t size) {
+  if (void *p = counted(size)) {
+    return p;
+  }
+  throw std::bad_alloc{};
+}
+void *operator new[](size_t size) { return operator new(size); }
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+  return counted(size);
+}
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+  return counted(size);
+}
+void *operator new(size_t size, std::align_val_t align) {
+  if (void *p = counted_aligned(size, align)) {
+    return p;
+  }
+  throw std::bad_alloc{};
+}
+void *operator new[](size_t size, std::align_val_t align) {
+  return operator new(size, align);
+}
+void *operator new(size_t size, std::align_val_t align,
+                   const std::nothrow_t &) noexcept {
+  return counted_aligned(size, align);
+}
+void *operator new[](size_t size, std::align_val_t align,
+                     const std::nothrow_t &) noexcept {
+  return counted_aligned(size, align);
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+void operator delete[](void *p, size_t) noexcept { std::free(p); }
+void operator delete(void *p, const std::nothrow_t &) noexcept {
+  std::free(p);
+}
+void operator delete[](void *p, const std::nothrow_t &) noexcept {
+  std::free(p);
+}
+void operator delete(void *p, std::align_val_t) noexcept { free_aligned(p); }
+void operator delete[](void *p, std::align_val_t) noexcept {
+  free_aligned(p);
+}
+void operator delete(void *p, size_t, std::align_val_t) noexcept {
+  free_aligned(p);
+}
+void operator delete[](void *p, size_t, std::align_val_t) noexcept {
+  free_aligned(p);
+}
+void operator delete(void *p, std::align_val_t,
+                     const std::nothrow_t &) noexcept {
+  free_aligned(p);
+}
+void operator delete[](void *p, std::align_val_t,
+                       const std::nothrow_t &) noexcept {
+  free_aligned(p);
+}
+
+AllocCount thread_allocs() { return t_allocs; }
+
+AllocScope::~AllocScope() {
+  AllocCount made{t_allocs.count - _start.count,
+                  t_allocs.bytes - _start.bytes};
+  std::lock_guard lock(tags_mutex);
+  AllocTag *tag = std::find_if(tags, tags + tag_count, [&](const AllocTag &t) {
+    return std::strcmp(t.name, _name) == 0;
+  });
+  if (tag == tags + tag_count) {
+    if (tag_count == max_tags) {
+      return;
+    }
+    tag_count += 1;
+    *tag = AllocTag{_name};
+  }
+  tag->calls += 1;
+  tag->total.count += made.count;
+  tag->total.bytes += made.bytes;
+  tag->last = made;
+  if (made.count > tag->peak.count) {
+    tag->peak = made;
+  }
+}
+
+size_t alloc_tags(AllocTag *out, size_t max) {
+  std::lock_guard lock(tags_mutex);
+  std::copy_n(tags, std::min(max, tag_count), out);
+  return tag_count;
+}
+
+AllocTag alloc_tag(const char *name) {
+  std::lock_guard lock(tags_mutex);
+  for (size_t k = 0; k < tag_count; ++k) {
+    if (std::strcmp(tags[k].name, name) == 0) {
+      return tags[k];
+    }
+  }
+  return AllocTag{name};
+}
+
+void reset_alloc_tags() {
+  std::lock_guard lock(tags_mutex);
+  tag_count = 0;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+// Heap allocation tracking. Binaries that link tiar2_alloc count every
+// operator new on each thread and attribute the counts to named scopes:
+//
+//   {
+//     AllocScope scope("game step");
+//     game.step();
+//   }
+//   AllocTag tag = alloc_tag("game step");
+//
+// Without tiar2_alloc (TIAR2_ALLOC_TRACKER undefined) everything here is a
+// no-op and every count is zero.
+
+#include <cstddef>
+#include <cstdint>
+
+struct AllocCount {
+  uint64_t count = 0;
+  uint64_t bytes = 0;
+};
+
+struct AllocTag {
+  const char *name = nullptr;
+  uint64_t calls = 0;
+  AllocCount total;
+  // Of the most recent call.
+  AllocCount last;
+  // Of the call that allocated most often.
+  AllocCount peak;
+};
+
+#ifdef TIAR2_ALLOC_TRACKER
+
+constexpr bool alloc_tracking = true;
+
+// Allocations made so far by the calling thread.
+AllocCount thread_allocs();
+// Copies up to max tags, in order of first use, and returns how many there
+// are. Doesn't allocate, so it can be called inside a scope.
+size_t alloc_tags(AllocTag *out, size_t max);
+// The tag of that name, empty if no scope of it has ended yet.
+AllocTag alloc_tag(const char *name);
+void reset_alloc_tags();
+
+// Adds what the calling thread allocates during its lifetime to the tag of
+// that name. Scopes nest, an outer one includes its inner ones. Up to 64
+// distinct names are recorded.
+class AllocScope {
+  const char *_name;
+  AllocCount _start;
+
+public:
+  explicit AllocScope(const char *name)
+      : _name{name}, _start{thread_allocs()} {}
+  ~AllocScope();
+  AllocScope(const AllocScope &) = delete;
+  AllocScope &operator=(const AllocScope &) = delete;
+};
+
+#else
+
+constexpr bool alloc_tracking = false;
+
+inline AllocCount thread_allocs() { return {}; }
+inline size_t alloc_tags(AllocTag *, size_t) { return 0; }
+inline AllocTag alloc_tag(const char *name) { return {name}; }
+inline void reset_alloc_tags() {}
+
+class AllocScope {
+public:
+  explicit AllocScope(const char *) {}
+  AllocScope(const AllocScope &) = delete;
+  AllocScope &operator=(const AllocScope &) = delete;
+};
+
+#endif
@@ -0,0 +1,281 @@
+// Headless balance analyzer. Plays many seeded games with random legal moves
+// for every combination of the given rule values, on all cores, and reports
+// the score distribution, cascade depth and pattern frequencies of each.
+//
+// Usage: tiar2_analyze [key=value[,value...]...]
+//
+//   games=10000   games per combination
+//   size=8        board size
+//   seed=1        game g of every combination uses seed + g, so that all
+//                 combinations start from the same random streams
+//   threads=N     worker threads, all cores by default
+//   rules=FILE    rule set to start from, see rule_set.h
+//
+// and the fields of Rules, each a comma-separated list of values to try:
+// colors, magic_odds, bonus_odds, magic_score, bonus_score, move_limit,
+// line_clear_run, blast_run. Fields that aren't listed keep the value of
+// the rule set.
+//
+// Example: tiar2_analyze games=100000 colors=5,6 magic_odds=21,42,84
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <exception>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "board.h"
+#include "game.h"
+#include "rule_set.h"
+
+// Cascades of this many removal steps or more share the last bucket.
+constexpr int max_depth = 16;
+
+struct Stats {
+  std::vector<int> scores;
+  std::array<long long, max_depth + 1> depths{};
+  long long moves = 0;
+  long long normals = 0;
+  long long longers = 0;
+  long long longests = 0;
+  long long crosses = 0;
+  // Games that ran out of moves before the move limit.
+  long long stuck = 0;
+
+  void merge(const Stats &o) {
+    scores.insert(scores.end(), o.scores.begin(), o.scores.end());
+    for (int d = 0; d <= max_depth; ++d) {
+      depths[d] += o.depths[d];
+    }
+    moves += o.moves;
+    normals += o.normals;
+    longers += o.longers;
+    longests += o.longests;
+    crosses += o.crosses;
+    stuck += o.stuck;
+  }
+};
+
+template <typename B>
+void play(const Rules &rules, int size, unsigned seed, Stats &stats) {
+  BasicGame<B> game(size, rules);
+  game.seed(seed);
+  game.new_game();
+  std::mt19937 pick(seed);
+  auto &b = game.board();
+  while (!game.is_finished()) {
+    if (!b.has_any_move()) {
+      stats.stuck += 1;
+      break;
+    }
+    // The k-th legal swap in board order.
+    int k = pick() % b.legal_move_count();
+    bool played = false;
+    for (int i = 0; i < size && !played; ++i) {
+      for (int j = 0; j < size && !played; ++j) {
+        for (auto [i2, j2] : {std::pair{i + 1, j}, std::pair{i, j + 1}}) {
+          if (!played && b.is_legal_swap(i, j, i2, j2) && k-- == 0) {
+            game.attempt_move(i, j, i2, j2);
+            played = true;
+          }
+        }
+      }
+    }
+    stats.depths[std::min(game.settle(), max_depth)] += 1;
+    stats.moves += 1;
+  }
+  stats.scores.push_back(b.score);
+  stats.normals += b.normals;
+  stats.longers += b.longers;
+  stats.longests += b.longests;
+  stats.crosses += b.crosses;
+}
+
+template <typename B>
+Stats run(const Rules &rules, int games, int size, unsigned seed,
+          unsigned threads) {
+  std::vector<Stats> partial(threads);
+  std::atomic<int> next = 0;
+  std::vector<std::thread> pool;
+  for (unsigned t = 0; t < threads; ++t) {
+    pool.emplace_back([&, t] {
+      for (int g; (g = next++) < games;) {
+        play<B>(rules, size, seed + g, partial[t]);
+      }
+    });
+  }
+  Stats total;
+  for (unsigned t = 0; t < threads; ++t) {
+    pool[t].join();
+    total.merge(partial[t]);
+  }
+  return total;
+}
+
+void report(const Rules &r, const Stats &s, double seconds) {
+  std::cout << fmt::format("colors={} magic_odds={} bonus_odds={} "
+                           "magic_score={} bonus_score={} move_limit={} "
+                           "line_clear_run={} blast_run={}\n",
+                           r.colors, r.magic_odds, r.bonus_odds, r.magic_score,
+                           r.bonus_score, r.move_limit, r.line_clear_run,
+                           r.blast_run);
+  auto scores = s.scores;
+  std::sort(scores.begin(), scores.end());
+  double games = scores.size();
+  double mean = 0;
+  for (int v : scores) {
+    mean += v;
+  }
+  mean /= games;
+  double var = 0;
+  for (int v : scores) {
+    var += (v - mean) * (v - mean);
+  }
+  auto pct = [&](double p) { return scores[size_t(p * (games - 1))]; };
+  std::cout << fmt::format("  {} games, {} moves, {} stuck, {:.1f} s\n",
+                           scores.size(), s.moves, s.stuck, seconds);
+  std::cout << fmt::format("  score: mean {:.1f}, sd {:.1f}, min {}, p10 {}, "
+                           "p50 {}, p90 {}, p99 {}, max {}\n",
+                           mean, std::sqrt(var / games), scores.front(),
+                           pct(0.1), pct(0.5), pct(0.9), pct(0.99),
+                           scores.back());
+  long long steps = 0;
+  int deepest = 0;
+  for (int d = 0; d <= max_depth; ++d) {
+    steps += d * s.depths[d];
+    deepest = s.depths[d] ? d : deepest;
+  }
+  std::cout << fmt::format("  cascade depth: mean {:.2f}, share of moves",
+                           double(steps) / s.moves);
+  for (int d = 1; d <= deepest; ++d) {
+    std::cout << fmt::format(" {}{}: {:.2f}%", d, d == max_depth ? "+" : "",
+                             100.0 * s.depths[d] / s.moves);
+  }
+  std::cout << fmt::format("\n  per game: normals {:.2f}, longers {:.2f}, "
+                           "longests {:.2f}, crosses {:.2f}\n\n",
+                           s.normals / games, s.longers / games,
+                           s.longests / games, s.crosses / games);
+}
+
+int main(int argc, char **argv) {
+  int games = 10000;
+  int size = 8;
+  unsigned seed = 1;
+  unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+  Rules defaults;
+  // Values to try, the default alone when empty.
+  std::map<std::string, std::pair<int Rules::*, std::vector<int>>> grid{
+      {"colors", {&Rules::colors, {}}},
+      {"magic_odds", {&Rules::magic_odds, {}}},
+      {"bonus_odds", {&Rules::bonus_odds, {}}},
+      {"magic_score", {&Rules::magic_score, {}}},
+      {"bonus_score", {&Rules::bonus_score, {}}},
+      {"move_limit", {&Rules::move_limit, {}}},
+      {"line_clear_run", {&Rules::line_clear_run, {}}},
+      {"blast_run", {&Rules::blast_run, {}}},
+  };
+  auto usage = [] {
+    std::cerr << "Usage: tiar2_analyze [games=N] [size=N] [seed=N] "
+                 "[threads=N] [rules=FILE] [colors|magic_odds|bonus_odds|"
+                 "magic_score|bonus_score|move_limit|line_clear_run|"
+                 "blast_run=v1,v2,...]\n";
+    return 1;
+  };
+  try {
+    for (int a = 1; a < argc; ++a) {
+      std::string arg = argv[a];
+      auto eq = arg.find('=');
+      if (eq == std::string::npos) {
+        return usage();
+      }
+      std::string key = arg.substr(0, eq);
+      std::string value = arg.substr(eq + 1);
+      if (key == "games") {
+        games = std::stoi(value);
+      } else if (key == "size") {
+        size = std::stoi(value);
+      } else if (key == "seed") {
+        seed = std::stoul(value);
+      } else if (key == "threads") {
+        threads = std::stoi(value);
+      } else if (key == "rules") {
+        std::string error;
+        auto set = load_rule_set(value.c_str(), error);
+        if (!set) {
+          std::cerr << "Can't use the rules in " << value << ", " << error
+                    << "\n";
+          return 1;
+        }
+        defaults = set->rules;
+      } else if (grid.contains(key)) {
+        auto &values = grid[key].second;
+        values.clear();
+        for (size_t p = 0; p <= value.size();) {
+          auto comma = std::min(value.find(',', p), value.size());
+          values.push_back(std::stoi(value.substr(p, comma - p)));
+          p = comma + 1;
+        }
+      } else {
+        return usage();
+      }
+    }
+  } catch (const std::exception &) {
+    return usage();
+  }
+  if (games < 1 || size < 3 || threads < 1) {
+    return usage();
+  }
+  // Every combination of the listed values, keys in alphabetical order, the
+  // first one changing slowest.
+  std::vector<Rules> combinations{defaults};
+  for (auto &[key, field] : grid) {
+    auto [member, values] = field;
+    if (values.empty()) {
+      values.push_back(defaults.*member);
+    }
+    std::vector<Rules> expanded;
+    for (const Rules &r : combinations) {
+      for (int v : values) {
+        expanded.push_back(r);
+        expanded.back().*member = v;
+      }
+    }
+    combinations = std::move(expanded);
+  }
+  for (const Rules &r : combinations) {
+    std::string error;
+    if (!validate(r, error)) {
+      std::cerr << error << "\n";
+      return 1;
+    }
+  }
+  for (const Rules &r : combinations) {
+    auto t0 = std::chrono::steady_clock::now();
+    Stats stats;
+    switch (size) {
+    case 8:
+      stats = run<Board8>(r, games, size, seed, threads);
+      break;
+    case 10:
+      stats = run<Board10>(r, games, size, seed, threads);
+      break;
+    case 16:
+      stats = run<Board16>(r, games, size, seed, threads);
+      break;
+    default:
+      stats = run<Board>(r, games, size, seed, threads);
+    }
+    std::chrono::duration<double> t = std::chrono::steady_clock::now() - t0;
+    report(r, stats, t.count());
+  }
+  return 0;
+}
@@ -0,0 +1,426 @@
+#include "batch.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+
+// Calls f(k) for every nonzero p[k], skipping eight zero bytes at a time.
+template <typename F> void for_each_set(const uint8_t *p, size_t n, F f) {
+  size_t k = 0;
+  for (; k + 8 <= n; k += 8) {
+    uint64_t word;
+    std::memcpy(&word, p + k, sizeof(word));
+    if (word == 0) {
+      continue;
+    }
+    for (size_t l = k; l < k + 8; ++l) {
+      if (p[l]) {
+        f(l);
+      }
+    }
+  }
+  for (; k < n; ++k) {
+    if (p[k]) {
+      f(k);
+    }
+  }
+}
+
+// Group coordinates and run lengths are kept in bytes.
+int checked_side(int side) {
+  if (side < 3 || side > 255) {
+    throw std::invalid_argument("BoardBatch boards must be 3..255 a side");
+  }
+  return side;
+}
+
+} // namespace
+
+BoardBatch::BoardBatch(size_t count, int width, int height,
+                       const Rules &rules)
+    : n{count}, w{checked_side(width)}, h{checked_side(height)}, lanes(count),
+      rules{rules},
+      uniform_dist(1, rules.colors), uniform_dist_2(0, width - 1),
+      uniform_dist_3(0, height - 1), coin(1, rules.magic_odds),
+      coin2(1, rules.bonus_odds),
+      run_h(count * width * height), run_v(count * width * height),
+      hits(count), need(count), active(count), none(count),
+      in_column(width * height),
+      tiles(count * width * height), magic(count * width * height),
+      legal_moves(count * width * height), score(count), normals(count),
+      longers(count), longests(count), crosses(count), counter(count),
+      accepted(count), groups(count), has_move(count) {}
+
+void BoardBatch::reset(size_t b, unsigned seed) {
+  Board board(w, h, rules);
+  board.seed(seed);
+  board.generate();
+  board.zero();
+  load(b, board);
+}
+
+void BoardBatch::step(const BatchMove *moves) {
+  for (size_t b = 0; b < n; ++b) {
+    accepted[b] = 0;
+    groups[b] = 0;
+    active[b] = 0;
+    int i1 = moves[b].row1;
+    int j1 = moves[b].col1;
+    int i2 = moves[b].row2;
+    int j2 = moves[b].col2;
+    if (i1 > i2 || j1 > j2) {
+      std::swap(i1, i2);
+      std::swap(j1, j2);
+    }
+    if (i1 < 0 || j1 < 0 || i2 >= w || j2 >= h || i2 - i1 + j2 - j1 != 1 ||
+        !(legal_moves[(i1 * h + j1) * n + b] & (i2 > i1 ? 1 : 2))) {
+      continue;
+    }
+    std::swap(tile(b, i1, j1), tile(b, i2, j2));
+    // Magic marks move the same way Board::swap() moves them.
+    auto &m1 = flags(b, i1, j1);
+    auto &m2 = flags(b, i2, j2);
+    for (uint8_t bit : {1, 2}) {
+      if (m1 & bit) {
+        m1 &= ~bit;
+        m2 |= bit;
+      }
+      if (m2 & bit) {
+        m2 &= ~bit;
+        m1 |= bit;
+      }
+    }
+    accepted[b] = 1;
+    active[b] = 1;
+    counter[b] += 1;
+  }
+  // Every board removes one group and refills per round, like
+  // Board::settle(); boards whose cascade is over just sit out.
+  while (true) {
+    bool any_need = false;
+    for (size_t b = 0; b < n; ++b) {
+      need[b] = active[b] && lanes[b].queue.empty();
+      any_need |= need[b];
+    }
+    if (any_need) {
+      prepare_removals();
+    }
+    bool any_active = false;
+    for_each_set(active.data(), n, [&](size_t b) {
+      if (lanes[b].queue.empty()) {
+        active[b] = 0;
+        return;
+      }
+      remove_one(b);
+      groups[b] += 1;
+      any_active = true;
+    });
+    if (!any_active) {
+      break;
+    }
+    fill_up();
+  }
+  update_moves(0, n);
+  for (size_t b = 0; b < n; ++b) {
+    if (accepted[b] && !has_move[b]) {
+      reshuffle(b);
+    }
+  }
+}
+
+void BoardBatch::remove_one(size_t b) {
+  auto &queue = lanes[b].queue;
+  Group g = queue.back();
+  queue.pop_back();
+  if (g.kind == 2) {
+    for (int i = std::max(0, g.i - 2); i <= std::min(w - 1, g.i + 2); ++i) {
+      for (int j = std::max(0, g.j - 2); j <= std::min(h - 1, g.j + 2); ++j) {
+        tile(b, i, j) = 0;
+        score[b] += 1;
+      }
+    }
+    crosses[b] += 1;
+    normals[b] = std::max(0, normals[b] - 2);
+    return;
+  }
+  auto clear = [&](int i, int j) {
+    tile(b, i, j) = 0;
+    auto &m = flags(b, i, j);
+    if (m & 1) {
+      score[b] += rules.magic_score;
+    }
+    if (m & 2) {
+      score[b] += rules.bonus_score;
+    }
+    m = 0;
+    score[b] += 1;
+  };
+  int len = g.len;
+  if (g.kind == 0) {
+    int j = g.j;
+    if (len == rules.line_clear_run) {
+      j = 0;
+      len = h;
+      longers[b] += 1;
+      normals[b] = std::max(0, normals[b] - 1);
+    }
+    for (int jj = j; jj < j + len; ++jj) {
+      clear(g.i, jj);
+    }
+  } else {
+    int i = g.i;
+    if (len == rules.line_clear_run) {
+      i = 0;
+      len = w;
+      longers[b] += 1;
+      normals[b] = std::max(0, normals[b] - 1);
+    }
+    for (int ii = i; ii < i + len; ++ii) {
+      clear(ii, g.j);
+    }
+  }
+  if (len == rules.blast_run) {
+    auto &e1 = lanes[b].e1;
+    std::vector<std::pair<int, int>> r;
+    r.reserve(w);
+    for (int k = 0; k < w; ++k) {
+      int x, y;
+      do {
+        x = uniform_dist_2(e1);
+        y = uniform_dist_3(e1);
+      } while (std::find(r.begin(), r.end(), std::pair{x, y}) != r.end());
+      r.emplace_back(x, y);
+      tile(b, x, y) = 0;
+      score[b] += 1;
+    }
+    longests[b] += 1;
+    normals[b] = std::max(0, normals[b] - 1);
+  }
+  normals[b] += 1;
+}
+
+void BoardBatch::fill_column(size_t b, int i, int j) {
+  auto &e1 = lanes[b].e1;
+  int curr_i = i;
+  while (curr_i < w - 1 && tile(b, curr_i + 1, j) == 0) {
+    curr_i += 1;
+  }
+  for (int k = curr_i; k >= 0; --k) {
+    if (tile(b, k, j) != 0) {
+      tile(b, curr_i, j) = tile(b, k, j);
+      auto &from = flags(b, k, j);
+      auto &to = flags(b, curr_i, j);
+      for (uint8_t bit : {1, 2}) {
+        if (from & bit) {
+          from &= ~bit;
+          to |= bit;
+        }
+      }
+      curr_i -= 1;
+    }
+  }
+  for (int k = curr_i; k >= 0; --k) {
+    tile(b, k, j) = uniform_dist(e1);
+    if (coin(e1) == 1) {
+      flags(b, k, j) |= 1;
+    }
+    if (coin2(e1) == 1) {
+      flags(b, k, j) |= 2;
+    }
+  }
+}
+
+void BoardBatch::fill_up() {
+  // Cells in Board::fill_up() order, boards innermost, so that every board
+  // draws its random numbers in the same order as a Board would.
+  const size_t count = n;
+  uint8_t *hit = hits.data();
+  for (int i = 0; i < w; ++i) {
+    for (int j = 0; j < h; ++j) {
+      kernels.zeros(&tiles[(i * h + j) * count], hit, count);
+      for_each_set(hit, count, [&](size_t b) { fill_column(b, i, j); });
+    }
+  }
+}
+
+void BoardBatch::prepare_removals() {
+  const size_t count = n;
+  uint8_t *hit = hits.data();
+  // Lengths of the runs starting at every cell, to the right and down, for
+  // all boards at once.
+  for (int i = w - 1; i >= 0; --i) {
+    for (int j = h - 1; j >= 0; --j) {
+      size_t c = (i * h + j) * n;
+      const uint8_t *t = &tiles[c];
+      uint8_t *rh = &run_h[c];
+      uint8_t *rv = &run_v[c];
+      if (j == h - 1) {
+        std::fill_n(rh, count, 1);
+      } else {
+        kernels.run_lengths(t, t + count, rh + count, rh, count);
+      }
+      if (i == w - 1) {
+        std::fill_n(rv, count, 1);
+      } else {
+        size_t below = h * count;
+        kernels.run_lengths(t, t + below, rv + below, rv, count);
+      }
+    }
+  }
+  // Runs are listed in the order Board::prepare_removals() finds them, every
+  // suffix of a long run included.
+  for (int i = 0; i < w; ++i) {
+    for (int j = 0; j < h; ++j) {
+      size_t c = (i * h + j) * n;
+      const uint8_t *rh = &run_h[c];
+      const uint8_t *rv = &run_v[c];
+      kernels.run_hits(rh, rv, need.data(), hit, count);
+      for_each_set(hit, count, [&](size_t b) {
+        auto &l = lanes[b];
+        if (hit[b] & 1) {
+          l.rows.push_back({0, uint8_t(i), uint8_t(j), rh[b]});
+        }
+        if (hit[b] & 2) {
+          l.cols.push_back({1, uint8_t(i), uint8_t(j), rv[b]});
+        }
+      });
+    }
+  }
+  auto sorter = [](const Group &g1, const Group &g2) { return g1.i > g2.i; };
+  for_each_set(need.data(), n, [&](size_t b) {
+    auto &l = lanes[b];
+    l.queue.clear();
+    // Crosses the way Board::find_crosses() finds them, in reverse.
+    if (!l.rows.empty() && !l.cols.empty()) {
+      auto column_cells = [&](uint8_t mark) {
+        for (const Group &c : l.cols) {
+          if (in_column[c.i * h + c.j] != mark) {
+            for (int k = c.i; k < c.i + c.len; ++k) {
+              in_column[k * h + c.j] = mark;
+            }
+          }
+        }
+      };
+      column_cells(1);
+      int last_i = -1;
+      int last_end = -1;
+      for (const Group &r : l.rows) {
+        if (r.i == last_i && r.j < last_end) {
+          continue;
+        }
+        last_i = r.i;
+        last_end = r.j + r.len;
+        for (int k = r.j; k < r.j + r.len; ++k) {
+          if (in_column[r.i * h + k]) {
+            l.queue.push_back({2, r.i, uint8_t(k), 0});
+          }
+        }
+      }
+      column_cells(0);
+      std::reverse(l.queue.begin(), l.queue.end());
+    }
+    // Same lists, same comparator and so the same order as Board's.
+    std::sort(l.cols.begin(), l.cols.end(), sorter);
+    std::sort(l.rows.begin(), l.rows.end(), sorter);
+    l.queue.insert(l.queue.end(), l.cols.begin(), l.cols.end());
+    l.queue.insert(l.queue.end(), l.rows.begin(), l.rows.end());
+    l.rows.clear();
+    l.cols.clear();
+  });
+}
+
+void BoardBatch::update_moves(size_t b0, size_t b1) {
+  auto cell = [&](int i, int j) -> const uint8_t * {
+    if (i < 0 || i >= w || j < 0 || j >= h) {
+      return none.data();
+    }
+    return &tiles[(i * h + j) * n];
+  };
+  // Neighbours of (i, j) once it is swapped with (pi, pj): the partner holds
+  // a different colour, so that arm stops right away.
+  auto arms = [&](int i, int j, int pi, int pj, const uint8_t **a) {
+    for (auto [di, dj] : {std::pair{-1, 0}, {1, 0}, {0, -1}, {0, 1}}) {
+      bool partner = i + di == pi && j + dj == pj;
+      *a++ = partner ? none.data() : cell(i + di, j + dj);
+      *a++ = cell(i + 2 * di, j + 2 * dj);
+    }
+  };
+  uint8_t *any = has_move.data();
+  std::fill(any + b0, any + b1, 0);
+  for (int i = 0; i < w; ++i) {
+    for (int j = 0; j < h; ++j) {
+      uint8_t *lm = &legal_moves[(i * h + j) * n];
+      const uint8_t *a = cell(i, j);
+      std::fill(lm + b0, lm + b1, 0);
+      for (uint8_t dir : {1, 2}) {
+        int i2 = i + (dir == 1);
+        int j2 = j + (dir == 2);
+        if (i2 >= w || j2 >= h) {
+          continue;
+        }
+        const uint8_t *x[8];
+        const uint8_t *y[8];
+        arms(i, j, i2, j2, x);
+        arms(i2, j2, i, j, y);
+        kernels.mark_swaps(a, cell(i2, j2), x, y, dir, lm, b0, b1);
+      }
+      for (size_t b = b0; b < b1; ++b) {
+        any[b] |= lm[b] != 0;
+      }
+    }
+  }
+}
+
+bool BoardBatch::reshuffle(size_t b, int attempts) {
+  std::vector<std::pair<uint8_t, uint8_t>> cells;
+  cells.reserve(w * h);
+  for (int i = 0; i < w; ++i) {
+    for (int j = 0; j < h; ++j) {
+      cells.emplace_back(tile(b, i, j), flags(b, i, j));
+    }
+  }
+  std::vector<std::pair<uint8_t, uint8_t>> pool = cells;
+  auto place = [&](const std::vector<std::pair<uint8_t, uint8_t>> &from) {
+    for (int i = 0; i < w; ++i) {
+      for (int j = 0; j < h; ++j) {
+        std::tie(tile(b, i, j), flags(b, i, j)) = from[i * h + j];
+      }
+    }
+  };
+  // The same arrangement as Board::reshuffle().
+  for (int k = 0; k < attempts; ++k) {
+    std::shuffle(std::begin(pool), std::end(pool), lanes[b].e1);
+    int c = 0;
+    for (; c < w * h; ++c) {
+      int i = c / h;
+      int j = c % h;
+      int up = i >= 2 && at(b, i - 1, j) == at(b, i - 2, j) ? at(b, i - 1, j)
+                                                             : 0;
+      int left = j >= 2 && at(b, i, j - 1) == at(b, i, j - 2)
+                     ? at(b, i, j - 1)
+                     : 0;
+      auto fits = std::find_if(pool.begin() + c, pool.end(), [&](auto &t) {
+        return t.first != up && t.first != left;
+      });
+      if (fits == pool.end()) {
+        break;
+      }
+      std::iter_swap(pool.begin() + c, fits);
+      tile(b, i, j) = pool[c].first;
+    }
+    if (c < w * h) {
+      continue;
+    }
+    place(pool);
+    update_moves(b, b + 1);
+    if (has_move[b]) {
+      return true;
+    }
+  }
+  place(cells);
+  update_moves(b, b + 1);
+  return false;
+}
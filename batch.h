@@ -0,0 +1,131 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "board.h"
+#include "kernels.h"
+
+// One move for one board of a batch. A negative row1 means no move.
+struct BatchMove {
+  int16_t row1 = -1;
+  int16_t col1 = 0;
+  int16_t row2 = 0;
+  int16_t col2 = 0;
+};
+
+// Many boards of the same size stepped together, for training loops that
+// play thousands of games at once. Every per-cell plane is interleaved
+// across boards, cell-major: the value of board b at (i, j) lives at
+// [(i * height() + j) * size() + b], so that one pass over a plane handles
+// the same cell of every board with contiguous loads.
+//
+// Each board follows exactly the rules and the random sequence of a Board
+// with the same seed that is played through Board::swap() and
+// Board::settle().
+class BoardBatch {
+  struct Group {
+    // 0 - row run, 1 - column run, 2 - cross.
+    uint8_t kind;
+    uint8_t i;
+    uint8_t j;
+    uint8_t len;
+  };
+  struct Lane {
+    std::default_random_engine e1;
+    // Pending groups, removed from the back one per cascade step.
+    std::vector<Group> queue;
+    std::vector<Group> rows;
+    std::vector<Group> cols;
+  };
+
+  size_t n;
+  int w;
+  int h;
+  std::vector<Lane> lanes;
+  const LaneKernels &kernels = lane_kernels();
+  Rules rules;
+  std::uniform_int_distribution<int> uniform_dist;
+  std::uniform_int_distribution<int> uniform_dist_2;
+  std::uniform_int_distribution<int> uniform_dist_3;
+  std::uniform_int_distribution<int> coin;
+  std::uniform_int_distribution<int> coin2;
+  // Scratch planes for prepare_removals().
+  std::vector<uint8_t> run_h;
+  std::vector<uint8_t> run_v;
+  std::vector<uint8_t> hits;
+  std::vector<uint8_t> need;
+  std::vector<uint8_t> active;
+  std::vector<uint8_t> none;
+  // Cells of column runs while crosses are looked for, zero otherwise.
+  std::vector<uint8_t> in_column;
+
+  uint8_t &tile(size_t b, int i, int j) { return tiles[(i * h + j) * n + b]; }
+  uint8_t &flags(size_t b, int i, int j) { return magic[(i * h + j) * n + b]; }
+  void remove_one(size_t b);
+  void fill_column(size_t b, int i, int j);
+  void fill_up();
+  void prepare_removals();
+  void update_moves(size_t b0, size_t b1);
+  bool reshuffle(size_t b, int attempts = 1000);
+
+public:
+  // Tiles 1..colors of the rules and magic flags (1 - magic, 2 - bonus),
+  // interleaved.
+  std::vector<uint8_t> tiles;
+  std::vector<uint8_t> magic;
+  // Legal swaps, 1 - with the cell below, 2 - with the cell to the right.
+  std::vector<uint8_t> legal_moves;
+  // Per-board counters, indexed by board.
+  std::vector<int32_t> score;
+  std::vector<int32_t> normals;
+  std::vector<int32_t> longers;
+  std::vector<int32_t> longests;
+  std::vector<int32_t> crosses;
+  // Moves played since the last reset, like BasicGame::counter.
+  std::vector<int32_t> counter;
+  // Per-board results of the last step(): whether the move was legal and
+  // played, how many groups its cascade removed, whether any swap is left.
+  // A board without swaps after its move is reshuffled as by Board::settle(),
+  // so has_move is only 0 when no arrangement of its tiles has one.
+  std::vector<uint8_t> accepted;
+  std::vector<int32_t> groups;
+  std::vector<uint8_t> has_move;
+
+  // Throws std::invalid_argument unless width and height are 3..255.
+  BoardBatch(size_t count, int width, int height, const Rules &rules = {});
+  size_t size() const { return n; }
+  int width() const { return w; }
+  int height() const { return h; }
+  int at(size_t b, int i, int j) const { return tiles[(i * h + j) * n + b]; }
+  // Starts a new game on board b, the way BasicGame::new_game() does.
+  void reset(size_t b, unsigned seed);
+  // Copies an idle board, including its random state, into slot b. The
+  // board is expected to play by the rules of the batch.
+  template <size_t W, size_t H> void load(size_t b, const BasicBoard<W, H> &src);
+  // Plays one move per board and runs all cascades to the end in lockstep.
+  // moves holds size() entries.
+  void step(const BatchMove *moves);
+};
+
+template <size_t W, size_t H>
+void BoardBatch::load(size_t b, const BasicBoard<W, H> &src) {
+  assert(src.width() == w && src.height() == h);
+  for (int i = 0; i < w; ++i) {
+    for (int j = 0; j < h; ++j) {
+      tile(b, i, j) = src.at(i, j);
+      flags(b, i, j) = src.is_magic(i, j) | src.is_magic2(i, j) << 1;
+    }
+  }
+  lanes[b].e1 = src.e1;
+  lanes[b].queue.clear();
+  score[b] = src.score;
+  normals[b] = src.normals;
+  longers[b] = src.longers;
+  longests[b] = src.longests;
+  crosses[b] = src.crosses;
+  counter[b] = 0;
+  update_moves(b, b + 1);
+}
@@ -0,0 +1,6 @@
+#include "board.h"
+
+template class BasicBoard<>;
+template class BasicBoard<8, 8>;
+template class BasicBoard<10, 10>;
+template class BasicBoard<16, 16>;
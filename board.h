@@ -0,0 +1,1018 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+#include <limits>
+#include <random>
+#include <tuple>
+#include <vector>
+
+#include "generator.h"
+
+struct Point {
+  int _x = 0;
+  int _y = 0;
+  int y() const { return _y; }
+  int x() const { return _x; }
+  void setX(int x) { _x = x; }
+  void setY(int y) { _y = y; }
+  friend Point operator-(const Point &a, const Point &b);
+  Point &operator-=(const Point &a) {
+    *this = *this - a;
+    return *this;
+  }
+};
+
+inline Point operator-(const Point &a, const Point &b) {
+  return Point{a._x - b._x, a._y - b._y};
+}
+
+using Pattern = std::vector<Point>;
+
+struct SizedPattern {
+  Pattern pat;
+  int w;
+  int h;
+};
+
+inline Pattern shift(Pattern &p) {
+  int minX = std::numeric_limits<int>::max();
+  int minY = std::numeric_limits<int>::max();
+  for (Point &pt : p) {
+    minX = std::min(pt.x(), minX);
+    minY = std::min(pt.y(), minY);
+  }
+  Pattern res(p);
+  for (Point &pt : res) {
+    pt -= Point{minX, minY};
+  }
+  return res;
+}
+
+inline std::vector<Pattern> rotations(Pattern &p) {
+  std::vector<Pattern> res(4);
+  res[0] = p;
+  for (int i = 1; i < 4; ++i) {
+    Pattern rotated(p.size());
+    for (auto j = 0u; j < p.size(); ++j) {
+      rotated[j].setX(res[i - 1][j].y());
+      rotated[j].setY(-res[i - 1][j].x());
+    }
+    res[i] = shift(rotated);
+  }
+  return res;
+}
+
+inline Pattern mirrored(Pattern &p) {
+  Pattern m(p);
+  for (auto i = 0u; i < p.size(); ++i) {
+    m[i].setY(-p[i].y());
+  }
+  return shift(m);
+}
+
+inline SizedPattern sized(Pattern &p) {
+  SizedPattern res;
+  res.pat = p;
+  int maxX = std::numeric_limits<int>::min();
+  int maxY = std::numeric_limits<int>::min();
+  for (Point &pt : p) {
+    maxX = std::max(pt.x(), maxX);
+    maxY = std::max(pt.y(), maxY);
+  }
+  res.w = maxX + 1;
+  res.h = maxY + 1;
+  return res;
+}
+
+inline std::vector<SizedPattern> generate(Pattern p, bool symmetric = false) {
+  auto s = rotations(p);
+  std::vector<Pattern> res1;
+  if (!symmetric) {
+    Pattern m = mirrored(p);
+    auto r = rotations(m);
+    res1.reserve(s.size() + r.size());
+    std::copy(r.begin(), r.end(), std::back_inserter(res1));
+  } else {
+    res1.reserve(s.size());
+  }
+  std::copy(s.begin(), s.end(), std::back_inserter(res1));
+  std::vector<SizedPattern> res2;
+  res2.reserve(res1.size());
+  std::transform(res1.begin(), res1.end(), std::back_inserter(res2),
+                 [](Pattern &pt) { return sized(pt); });
+  return res2;
+}
+
+// The move patterns of the default rule set, see rule_set.h.
+inline const Pattern three_p_1 = {{0, 0}, {1, 1}, {0, 2}};
+inline const Pattern three_p_2 = {{1, 0}, {0, 1}, {0, 2}};
+inline const Pattern three_p_3 = {{0, 0}, {0, 1}, {0, 3}};
+inline const Pattern four_p = {{0, 0}, {1, 1}, {0, 2}, {0, 3}};
+inline const Pattern five_p_1 = {{0, 0}, {0, 1}, {1, 2}, {0, 3}, {0, 4}};
+inline const Pattern five_p_2 = {{0, 0}, {1, 1}, {1, 2}, {2, 0}, {3, 0}};
+
+inline uint64_t zobrist_key(int cell, int kind) {
+  // splitmix64 of the (cell, kind) pair, so that no table has to be sized
+  // for the largest board.
+  uint64_t z = (uint64_t(cell) << 4 | uint64_t(kind)) + 0x9e3779b97f4a7c15ull;
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+  return z ^ (z >> 31);
+}
+
+constexpr size_t dynamic_size = 0;
+
+// One item of a move's cascade: a removed group, then the refill after it.
+struct CascadeStep {
+  enum Kind { removal, refill };
+  Kind kind;
+  // Removed cells of a removal, as (row, column, tile).
+  std::vector<std::tuple<int, int, int>> cells;
+};
+
+// Groups found by prepare_removals(), each list popped from the back: runs
+// in rows as (row, column, length), then runs in columns, then crosses.
+struct Removals {
+  std::vector<std::tuple<int, int, int>> rows;
+  std::vector<std::tuple<int, int, int>> cols;
+  std::vector<std::pair<int, int>> crosses;
+};
+
+// Spawn odds and scoring, the knobs of game balance. The defaults are the
+// rules the game has always been played with.
+struct Rules {
+  // Tiles are 1..colors, 3 to 6 of them; with fewer no board ever settles.
+  int colors = 6;
+  // A new tile is magic with odds 1 in magic_odds, bonus 1 in bonus_odds.
+  int magic_odds = 42;
+  int bonus_odds = 69;
+  // Added to the score for every magic or bonus tile removed by a run.
+  int magic_score = -3;
+  int bonus_score = 3;
+  // Moves in one game, see BasicGame::is_finished().
+  int move_limit = 50;
+  // A run of line_clear_run tiles clears its whole row or column, a run of
+  // blast_run also removes as many random cells as the board has rows. 0
+  // turns either off.
+  int line_clear_run = 4;
+  int blast_run = 5;
+};
+
+// Dimensions and per-cell storage of a board. Fixed sizes keep everything in
+// std::array, so that the scan loops get compile-time bounds.
+template <size_t W, size_t H> struct BoardStorage {
+  static constexpr size_t w = W;
+  static constexpr size_t h = H;
+  std::array<int, W * H> board{};
+  // Magic marks, 1 - magic tile, 2 - bonus tile.
+  std::array<uint8_t, W * H> magic{};
+  // Legal swaps, 1 - with the cell below, 2 - with the cell to the right.
+  std::array<uint8_t, W * H> legal_moves{};
+  BoardStorage(size_t _w, size_t _h) { assert(_w == W && _h == H); }
+  bool resize(size_t _w, size_t _h) {
+    board.fill(0);
+    magic.fill(0);
+    legal_moves.fill(0);
+    return _w == W && _h == H;
+  }
+};
+
+template <> struct BoardStorage<dynamic_size, dynamic_size> {
+  size_t w;
+  size_t h;
+  std::vector<int> board;
+  std::vector<uint8_t> magic;
+  std::vector<uint8_t> legal_moves;
+  BoardStorage(size_t _w, size_t _h)
+      : w{_w}, h{_h}, board(w * h), magic(w * h), legal_moves(w * h) {}
+  bool resize(size_t _w, size_t _h) {
+    w = _w;
+    h = _h;
+    board.assign(w * h, 0);
+    magic.assign(w * h, 0);
+    legal_moves.assign(w * h, 0);
+    return true;
+  }
+};
+
+class BoardBatch;
+
+template <size_t W = dynamic_size, size_t H = dynamic_size>
+class BasicBoard : BoardStorage<W, H> {
+  using Storage = BoardStorage<W, H>;
+  using Storage::board;
+  using Storage::h;
+  using Storage::legal_moves;
+  using Storage::magic;
+  using Storage::w;
+  std::default_random_engine e1{static_cast<unsigned>(
+      std::chrono::system_clock::now().time_since_epoch().count())};
+  Rules _rules;
+  std::uniform_int_distribution<int> uniform_dist;
+  std::uniform_int_distribution<int> uniform_dist_2;
+  std::uniform_int_distribution<int> uniform_dist_3;
+  std::uniform_int_distribution<int> coin;
+  std::uniform_int_distribution<int> coin2;
+
+  std::vector<std::tuple<int, int, int>> rm_i;
+  std::vector<std::tuple<int, int, int>> rm_j;
+  std::vector<std::pair<int, int>> rm_b;
+  // Scratch for find_crosses(), all zero between calls.
+  std::vector<uint8_t> in_column;
+  // Crosses found by prepare_removals(), kept for their capacity.
+  std::vector<std::tuple<int, int, int>> cross_cells;
+  // Scratch for remove_random_cells(), all zero between calls.
+  std::vector<uint8_t> picked;
+  // Only the area of legal_moves touched since the last update is rechecked.
+  int legal_count = 0;
+  int dirty_i0 = std::numeric_limits<int>::max();
+  int dirty_i1 = -1;
+  int dirty_j0 = std::numeric_limits<int>::max();
+  int dirty_j1 = -1;
+  uint64_t tiles_hash = 0;
+  uint64_t magic_hash = 0;
+
+  void set(int a, int b, int v) {
+    auto &cell = board[a * h + b];
+    tiles_hash ^= zobrist_key(a * h + b, cell) ^ zobrist_key(a * h + b, v);
+    cell = v;
+    dirty_i0 = std::min(dirty_i0, a);
+    dirty_i1 = std::max(dirty_i1, a);
+    dirty_j0 = std::min(dirty_j0, b);
+    dirty_j1 = std::max(dirty_j1, b);
+  }
+  void set_magic(int a, int b, bool on) {
+    if (on == is_magic(a, b)) {
+      return;
+    }
+    magic[a * h + b] ^= 1;
+    magic_hash ^= zobrist_key(a * h + b, 7);
+  }
+  void set_magic2(int a, int b, bool on) {
+    if (on == is_magic2(a, b)) {
+      return;
+    }
+    magic[a * h + b] ^= 2;
+    magic_hash ^= zobrist_key(a * h + b, 8);
+  }
+  bool makes_run(int i, int j) const {
+    int c = at(i, j);
+    if (c == 0) {
+      return false;
+    }
+    int n = 1;
+    for (int k = i - 1; k >= 0 && at(k, j) == c; --k) {
+      n += 1;
+    }
+    for (int k = i + 1; k < int(w) && at(k, j) == c; ++k) {
+      n += 1;
+    }
+    if (n > 2) {
+      return true;
+    }
+    n = 1;
+    for (int k = j - 1; k >= 0 && at(i, k) == c; --k) {
+      n += 1;
+    }
+    for (int k = j + 1; k < int(h) && at(i, k) == c; ++k) {
+      n += 1;
+    }
+    return n > 2;
+  }
+  bool check_swap(int i1, int j1, int i2, int j2) {
+    auto &a = board[i1 * h + j1];
+    auto &b = board[i2 * h + j2];
+    if (a == b) {
+      return false;
+    }
+    std::swap(a, b);
+    bool res = makes_run(i1, j1) || makes_run(i2, j2);
+    std::swap(a, b);
+    return res;
+  }
+  void update_moves() {
+    if (dirty_i1 < 0) {
+      return;
+    }
+    // A swap looks at most two cells past either of its ends.
+    int i0 = std::max(0, dirty_i0 - 3);
+    int i1 = std::min(int(w) - 1, dirty_i1 + 3);
+    int j0 = std::max(0, dirty_j0 - 3);
+    int j1 = std::min(int(h) - 1, dirty_j1 + 3);
+    for (int i = i0; i <= i1; ++i) {
+      for (int j = j0; j <= j1; ++j) {
+        uint8_t m = 0;
+        if (i + 1 < int(w) && check_swap(i, j, i + 1, j)) {
+          m |= 1;
+        }
+        if (j + 1 < int(h) && check_swap(i, j, i, j + 1)) {
+          m |= 2;
+        }
+        auto &old = legal_moves[i * h + j];
+        legal_count += std::popcount(m) - std::popcount(old);
+        old = m;
+      }
+    }
+    dirty_i0 = std::numeric_limits<int>::max();
+    dirty_i1 = -1;
+    dirty_j0 = std::numeric_limits<int>::max();
+    dirty_j1 = -1;
+  }
+  // Makes an empty board of another size, for operator>>. Everything that
+  // depends on the size follows it.
+  bool resize(size_t _w, size_t _h) {
+    if (!Storage::resize(_w, _h)) {
+      return false;
+    }
+    uniform_dist_2 = std::uniform_int_distribution<int>(0, w - 1);
+    uniform_dist_3 = std::uniform_int_distribution<int>(0, h - 1);
+    legal_count = 0;
+    tiles_hash = 0;
+    for (int k = 0; k < w * h; ++k) {
+      tiles_hash ^= zobrist_key(k, 0);
+    }
+    magic_hash = 0;
+    return true;
+  }
+
+public:
+  int width() const { return w; }
+  int height() const { return h; }
+  const Rules &rules() const { return _rules; }
+  int score{};
+  int normals{};
+  int longers{};
+  int longests{};
+  int crosses{};
+  BasicBoard(size_t _w = W, size_t _h = H, const Rules &rules = {})
+      : Storage(_w, _h), _rules{rules}, uniform_dist{1, rules.colors},
+        coin{1, rules.magic_odds}, coin2{1, rules.bonus_odds} {
+    assert(rules.colors >= 3 && rules.colors <= 6);
+    for (int k = 0; k < w * h; ++k) {
+      tiles_hash ^= zobrist_key(k, 0);
+    }
+    uniform_dist_2 = std::uniform_int_distribution<int>(0, w - 1);
+    uniform_dist_3 = std::uniform_int_distribution<int>(0, h - 1);
+  }
+  BasicBoard(const BasicBoard &b)
+      : Storage(b), _rules{b._rules}, uniform_dist{b.uniform_dist},
+        coin{b.coin}, coin2{b.coin2} {
+    uniform_dist_2 = b.uniform_dist_2;
+    uniform_dist_3 = b.uniform_dist_3;
+    score = b.score;
+    normals = b.normals;
+    longers = b.longers;
+    longests = b.longests;
+    crosses = b.crosses;
+    legal_count = b.legal_count;
+    tiles_hash = b.tiles_hash;
+    magic_hash = b.magic_hash;
+  }
+  BasicBoard &operator=(const BasicBoard &b) {
+    Storage::operator=(b);
+    _rules = b._rules;
+    uniform_dist = b.uniform_dist;
+    coin = b.coin;
+    coin2 = b.coin2;
+    uniform_dist_2 = b.uniform_dist_2;
+    uniform_dist_3 = b.uniform_dist_3;
+    score = b.score;
+    normals = b.normals;
+    longers = b.longers;
+    longests = b.longests;
+    crosses = b.crosses;
+    legal_count = b.legal_count;
+    tiles_hash = b.tiles_hash;
+    magic_hash = b.magic_hash;
+    return *this;
+  }
+  template <size_t W2, size_t H2>
+  friend bool operator==(const BasicBoard<W2, H2> &a,
+                         const BasicBoard<W2, H2> &b);
+  template <size_t W2, size_t H2>
+  friend std::ostream &operator<<(std::ostream &of,
+                                  const BasicBoard<W2, H2> &b);
+  template <size_t W2, size_t H2>
+  friend std::istream &operator>>(std::istream &in, BasicBoard<W2, H2> &b);
+  friend class BoardBatch;
+  bool is_magic(int x, int y) const { return magic[x * h + y] & 1; }
+  bool is_magic2(int x, int y) const { return magic[x * h + y] & 2; }
+  // Zobrist hash of the tiles and magic marks, kept up to date by every
+  // write. Equal positions of the same size always hash equally.
+  uint64_t hash() const { return tiles_hash ^ magic_hash; }
+  void swap(int x1, int y1, int x2, int y2) {
+    auto tmp = at(x1, y1);
+    set(x1, y1, at(x2, y2));
+    set(x2, y2, tmp);
+
+    if (is_magic(x1, y1)) {
+      set_magic(x1, y1, false);
+      set_magic(x2, y2, true);
+    }
+
+    if (is_magic(x2, y2)) {
+      set_magic(x2, y2, false);
+      set_magic(x1, y1, true);
+    }
+
+    if (is_magic2(x1, y1)) {
+      set_magic2(x1, y1, false);
+      set_magic2(x2, y2, true);
+    }
+
+    if (is_magic2(x2, y2)) {
+      set_magic2(x2, y2, false);
+      set_magic2(x1, y1, true);
+    }
+    update_moves();
+  }
+  void fill() {
+    for (int i = 0; i < w; ++i) {
+      for (int j = 0; j < h; ++j) {
+        set(i, j, uniform_dist(e1));
+      }
+    }
+    update_moves();
+  }
+  // Builds a board without runs in one pass: every cell gets a random colour
+  // other than one that would complete a run with the two cells above it or
+  // the two to its left. Magic marks are cleared and nothing is scored. With
+  // ensure_move a board without legal swaps is made again, up to attempts
+  // times; false means the last one still has none, which only small boards
+  // with many colours ever run into.
+  bool generate(bool ensure_move = true, int attempts = 1000) {
+    int allowed[6];
+    for (int k = 0; k < attempts; ++k) {
+      for (int i = 0; i < w; ++i) {
+        for (int j = 0; j < h; ++j) {
+          int up = i >= 2 && at(i - 1, j) == at(i - 2, j) ? at(i - 1, j) : 0;
+          int left =
+              j >= 2 && at(i, j - 1) == at(i, j - 2) ? at(i, j - 1) : 0;
+          int n = 0;
+          for (int c = 1; c <= _rules.colors; ++c) {
+            if (c != up && c != left) {
+              allowed[n++] = c;
+            }
+          }
+          set(i, j,
+              allowed[std::uniform_int_distribution<int>(0, n - 1)(e1)]);
+          set_magic(i, j, false);
+          set_magic2(i, j, false);
+        }
+      }
+      update_moves();
+      if (!ensure_move || has_any_move()) {
+        return true;
+      }
+    }
+    return false;
+  }
+  int at(int a, int b) const { return board[a * h + b]; }
+  bool has_any_move() const { return legal_count > 0; }
+  int legal_move_count() const { return legal_count; }
+  bool is_legal_swap(int x1, int y1, int x2, int y2) const {
+    if (!reasonable_coord(x1, y1) || !reasonable_coord(x2, y2)) {
+      return false;
+    }
+    if (x1 > x2 || y1 > y2) {
+      std::swap(x1, x2);
+      std::swap(y1, y2);
+    }
+    if (x2 - x1 + y2 - y1 != 1) {
+      return false;
+    }
+    return legal_moves[x1 * h + y1] & (x2 > x1 ? 1 : 2);
+  }
+  bool has_runs() const {
+    for (int i = 0; i < w; ++i) {
+      for (int j = 0; j < h; ++j) {
+        int c = at(i, j);
+        if (i + 2 < w && at(i + 1, j) == c && at(i + 2, j) == c) {
+          return true;
+        }
+        if (j + 2 < h && at(i, j + 1) == c && at(i, j + 2) == c) {
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+  // Rearranges the tiles (together with their magic marks) so that the
+  // board has no runs and at least one legal swap. Like generate(), every
+  // cell takes the first of the shuffled tiles left that doesn't complete a
+  // run with the two cells above it or the two to its left; an arrangement
+  // that runs out of such tiles or has no swap is tried again. If none of
+  // the attempts works the board keeps its tiles and false is returned.
+  // Scores are left untouched.
+  bool reshuffle(int attempts = 100) {
+    std::vector<std::tuple<int, bool, bool>> tiles;
+    tiles.reserve(w * h);
+    for (int i = 0; i < w; ++i) {
+      for (int j = 0; j < h; ++j) {
+        tiles.emplace_back(at(i, j), is_magic(i, j), is_magic2(i, j));
+      }
+    }
+    auto place = [&](int k, const std::tuple<int, bool, bool> &t) {
+      auto [c, m1, m2] = t;
+      set(k / h, k % h, c);
+      set_magic(k / h, k % h, m1);
+      set_magic2(k / h, k % h, m2);
+    };
+    std::vector<std::tuple<int, bool, bool>> pool = tiles;
+    for (int attempt = 0; attempt < attempts; ++attempt) {
+      std::shuffle(std::begin(pool), std::end(pool), e1);
+      int k = 0;
+      for (; k < w * h; ++k) {
+        int i = k / h;
+        int j = k % h;
+        int up = i >= 2 && at(i - 1, j) == at(i - 2, j) ? at(i - 1, j) : 0;
+        int left = j >= 2 && at(i, j - 1) == at(i, j - 2) ? at(i, j - 1) : 0;
+        auto fits = std::find_if(pool.begin() + k, pool.end(), [&](auto &t) {
+          return std::get<0>(t) != up && std::get<0>(t) != left;
+        });
+        if (fits == pool.end()) {
+          break;
+        }
+        std::iter_swap(pool.begin() + k, fits);
+        place(k, pool[k]);
+      }
+      if (k < w * h) {
+        continue;
+      }
+      update_moves();
+      if (has_any_move()) {
+        return true;
+      }
+    }
+    for (int k = 0; k < w * h; ++k) {
+      place(k, tiles[k]);
+    }
+    update_moves();
+    return false;
+  }
+  bool reasonable_coord(int i, int j) const {
+    return i >= 0 && i < w && j >= 0 && j < h;
+  }
+  // Cells that are in both a row run and a column run, as (row, start of
+  // the row run, column), each once, in scan order. Runs are given as scan
+  // entries, where the suffixes of a long run follow its first entry; they
+  // are skipped, which keeps this linear in the length of the runs.
+  void find_crosses(const std::vector<std::tuple<int, int, int>> &rows,
+                    const std::vector<std::tuple<int, int, int>> &cols,
+                    std::vector<std::tuple<int, int, int>> &res) {
+    res.clear();
+    if (rows.empty() || cols.empty()) {
+      return;
+    }
+    in_column.resize(w * h);
+    auto column_cells = [&](uint8_t mark) {
+      for (auto [i, j, len] : cols) {
+        if (in_column[i * h + j] != mark) {
+          for (int k = i; k < i + len; ++k) {
+            in_column[k * h + j] = mark;
+          }
+        }
+      }
+    };
+    column_cells(1);
+    int last_i = -1;
+    int last_end = -1;
+    for (auto [i, j, len] : rows) {
+      if (i == last_i && j < last_end) {
+        continue;
+      }
+      last_i = i;
+      last_end = j + len;
+      for (int k = j; k < j + len; ++k) {
+        if (in_column[i * h + k]) {
+          res.emplace_back(i, j, k);
+        }
+      }
+    }
+    column_cells(0);
+  }
+  void remove_trios() {
+    std::vector<std::tuple<int, int, int>> remove_i;
+    std::vector<std::tuple<int, int, int>> remove_j;
+    for (int i = 0; i < w; ++i) {
+      for (int j = 0; j < h; ++j) {
+        int offset_j = 1;
+        int offset_i = 1;
+        while (j + offset_j < h && at(i, j) == at(i, j + offset_j)) {
+          offset_j += 1;
+        }
+        if (offset_j > 2) {
+          remove_i.push_back({i, j, offset_j});
+        }
+        while (i + offset_i < w && at(i, j) == at(i + offset_i, j)) {
+          offset_i += 1;
+        }
+        if (offset_i > 2) {
+          remove_j.push_back({i, j, offset_i});
+        }
+      }
+    }
+    std::vector<std::tuple<int, int, int>> found;
+    find_crosses(remove_i, remove_j, found);
+    for (auto t : remove_i) {
+      int i = std::get<0>(t);
+      int j = std::get<1>(t);
+      int offset = std::get<2>(t);
+      if (offset == _rules.line_clear_run) {
+        j = 0;
+        offset = h;
+        longers += 1;
+        normals = std::max(0, normals - 1);
+      }
+      for (int jj = j; jj < j + offset; ++jj) {
+        set(i, jj, 0);
+        if (is_magic(i, jj)) {
+          score += _rules.magic_score;
+          set_magic(i, jj, false);
+        }
+        if (is_magic2(i, jj)) {
+          score += _rules.bonus_score;
+          set_magic2(i, jj, false);
+        }
+        score += 1;
+      }
+      if (offset == _rules.blast_run) {
+        for (int i = 0; i < w; ++i) {
+          set(uniform_dist_2(e1), uniform_dist_3(e1), 0);
+          score += 1;
+        }
+        longests += 1;
+        normals = std::max(0, normals - 1);
+      }
+      normals += 1;
+    }
+    for (auto t : remove_j) {
+      int i = std::get<0>(t);
+      int j = std::get<1>(t);
+      int offset = std::get<2>(t);
+      if (offset == _rules.line_clear_run) {
+        i = 0;
+        offset = w;
+        longers += 1;
+        normals = std::max(0, normals - 1);
+      }
+      for (int ii = i; ii < i + offset; ++ii) {
+        set(ii, j, 0);
+        if (is_magic(ii, j)) {
+          score += _rules.magic_score;
+          set_magic(ii, j, false);
+        }
+        if (is_magic2(ii, j)) {
+          score += _rules.bonus_score;
+          set_magic2(ii, j, false);
+        }
+        score += 1;
+      }
+      if (offset == _rules.blast_run) {
+        for (int i = 0; i < w; ++i) {
+          set(uniform_dist_2(e1), uniform_dist_3(e1), 0);
+          score += 1;
+        }
+        longests += 1;
+        normals = std::max(0, normals - 1);
+      }
+      normals += 1;
+    }
+    // Around the start of the row run, as the first of the entry pairs that
+    // meet at the cell used to be.
+    for (auto [i1, j1, j2] : found) {
+      for (int m = -1; m < 2; ++m) {
+        for (int n = -1; n < 2; ++n) {
+          if (reasonable_coord(i1 + m, j1 + n)) {
+            set(i1 + m, j1 + n, 0);
+            score += 1;
+          }
+        }
+      }
+      crosses += 1;
+      normals = std::max(0, normals - 2);
+    }
+  }
+  // Removes w distinct random cells, the blast of a quintet.
+  void remove_random_cells(std::vector<std::tuple<int, int, int>> &res) {
+    picked.resize(w * h);
+    for (int i = 0; i < w; ++i) {
+      int x, y;
+      do {
+        x = uniform_dist_2(e1);
+        y = uniform_dist_3(e1);
+      } while (picked[x * h + y]);
+      picked[x * h + y] = 1;
+      res.emplace_back(x, y, at(x, y));
+      set(x, y, 0);
+      score += 1;
+    }
+    for (auto it = res.end() - w; it != res.end(); ++it) {
+      picked[std::get<0>(*it) * h + std::get<1>(*it)] = 0;
+    }
+  }
+  void fill_up() {
+    int curr_i = -1;
+    for (int i = 0; i < w; ++i) {
+      for (int j = 0; j < h; ++j) {
+        if (at(i, j) == 0) {
+          curr_i = i;
+          while (curr_i < w - 1 && at(curr_i + 1, j) == 0) {
+            curr_i += 1;
+          }
+          for (int k = curr_i; k >= 0; --k) {
+            if (at(k, j) != 0) {
+              set(curr_i, j, at(k, j));
+              if (is_magic(k, j)) {
+                set_magic(k, j, false);
+                set_magic(curr_i, j, true);
+              }
+              if (is_magic2(k, j)) {
+                set_magic2(k, j, false);
+                set_magic2(curr_i, j, true);
+              }
+              curr_i -= 1;
+            }
+          }
+          for (int k = curr_i; k >= 0; --k) {
+            set(k, j, uniform_dist(e1));
+            if (coin(e1) == 1) {
+              set_magic(k, j, true);
+            }
+            if (coin2(e1) == 1) {
+              set_magic2(k, j, true);
+            }
+          }
+        }
+      }
+    }
+    update_moves();
+  }
+  void stabilize() {
+    auto old_board = *this;
+    do {
+      old_board = *this;
+      remove_trios();
+      fill_up();
+    } while (!(*this == old_board));
+  }
+  void step() {
+    remove_trios();
+    fill_up();
+  }
+  void seed(unsigned s) { e1.seed(s); }
+  void zero() {
+    score = 0;
+    normals = 0;
+    longers = 0;
+    longests = 0;
+    crosses = 0;
+  }
+  // New interface starts here
+  std::vector<std::tuple<int, int, int>> remove_one_thing() {
+    std::vector<std::tuple<int, int, int>> res;
+    // Sized up front, so that a step allocates once.
+    if (!rm_i.empty()) {
+      int offset = std::get<2>(rm_i.back());
+      res.reserve(offset == _rules.line_clear_run ? h
+                  : offset == _rules.blast_run    ? offset + w
+                                                  : offset);
+    } else if (!rm_j.empty()) {
+      int offset = std::get<2>(rm_j.back());
+      res.reserve(offset == _rules.line_clear_run ? w
+                  : offset == _rules.blast_run    ? offset + w
+                                                  : offset);
+    } else if (!rm_b.empty()) {
+      res.reserve(25);
+    }
+    if (!rm_i.empty()) {
+      auto t = rm_i.back();
+      int i = std::get<0>(t);
+      int j = std::get<1>(t);
+      int offset = std::get<2>(t);
+      if (offset == _rules.line_clear_run) {
+        j = 0;
+        offset = h;
+        longers += 1;
+        normals = std::max(0, normals - 1);
+      }
+      for (int jj = j; jj < j + offset; ++jj) {
+        res.emplace_back(i, jj, at(i, jj));
+        set(i, jj, 0);
+        if (is_magic(i, jj)) {
+          score += _rules.magic_score;
+          set_magic(i, jj, false);
+        }
+        if (is_magic2(i, jj)) {
+          score += _rules.bonus_score;
+          set_magic2(i, jj, false);
+        }
+        score += 1;
+      }
+      if (offset == _rules.blast_run) {
+        remove_random_cells(res);
+        longests += 1;
+        normals = std::max(0, normals - 1);
+      }
+      normals += 1;
+      rm_i.pop_back();
+      return res;
+    }
+    if (!rm_j.empty()) {
+      auto t = rm_j.back();
+      int i = std::get<0>(t);
+      int j = std::get<1>(t);
+      int offset = std::get<2>(t);
+      if (offset == _rules.line_clear_run) {
+        i = 0;
+        offset = w;
+        longers += 1;
+        normals = std::max(0, normals - 1);
+      }
+      for (int ii = i; ii < i + offset; ++ii) {
+        res.emplace_back(ii, j, at(ii, j));
+        set(ii, j, 0);
+        if (is_magic(ii, j)) {
+          score += _rules.magic_score;
+          set_magic(ii, j, false);
+        }
+        if (is_magic2(ii, j)) {
+          score += _rules.bonus_score;
+          set_magic2(ii, j, false);
+        }
+        score += 1;
+      }
+      if (offset == _rules.blast_run) {
+        remove_random_cells(res);
+        longests += 1;
+        normals = std::max(0, normals - 1);
+      }
+      normals += 1;
+      rm_j.pop_back();
+      return res;
+    }
+    if (!rm_b.empty()) {
+      auto t = rm_b.back();
+      int i = std::get<0>(t);
+      int j = std::get<1>(t);
+      for (int m = -2; m < 3; ++m) {
+        for (int n = -2; n < 3; ++n) {
+          if (reasonable_coord(i + m, j + n)) {
+            res.emplace_back(i + m, j + n, at(i + m, j + n));
+            set(i + m, j + n, 0);
+            score += 1;
+          }
+        }
+      }
+      crosses += 1;
+      normals = std::max(0, normals - 2);
+      rm_b.pop_back();
+      return res;
+    }
+    return res;
+  }
+  void prepare_removals() {
+    rm_i.clear();
+    rm_j.clear();
+    rm_b.clear();
+    for (int i = 0; i < w; ++i) {
+      for (int j = 0; j < h; ++j) {
+        int offset_j = 1;
+        int offset_i = 1;
+        while (j + offset_j < h && at(i, j) == at(i, j + offset_j)) {
+          offset_j += 1;
+        }
+        if (offset_j > 2) {
+          rm_i.emplace_back(i, j, offset_j);
+        }
+        while (i + offset_i < w && at(i, j) == at(i + offset_i, j)) {
+          offset_i += 1;
+        }
+        if (offset_i > 2) {
+          rm_j.emplace_back(i, j, offset_i);
+        }
+      }
+    }
+    // Popped from the back, so the topmost, then leftmost, cross goes first.
+    find_crosses(rm_i, rm_j, cross_cells);
+    for (auto it = cross_cells.rbegin(); it != cross_cells.rend(); ++it) {
+      rm_b.emplace_back(std::get<0>(*it), std::get<2>(*it));
+    }
+    auto sorter = [](auto &t1, auto &t2) {
+      auto i1 = std::get<0>(t1);
+      auto i2 = std::get<0>(t2);
+      return i1 > i2;
+    };
+    std::sort(std::begin(rm_i), std::end(rm_i), sorter);
+    std::sort(std::begin(rm_j), std::end(rm_j), sorter);
+  }
+  bool has_removals() { return rm_i.size() + rm_j.size() + rm_b.size(); }
+  // The pending groups, moved out, so that they can be found on a copy of
+  // the board and handed to the board itself with set_removals().
+  Removals take_removals() {
+    return {std::move(rm_i), std::move(rm_j), std::move(rm_b)};
+  }
+  void set_removals(Removals r) {
+    rm_i = std::move(r.rows);
+    rm_j = std::move(r.cols);
+    rm_b = std::move(r.crosses);
+  }
+  // Cells the next remove_one_thing() clears, as (row, column), without the
+  // random cells a quintet blows up.
+  std::vector<std::pair<int, int>> next_removal() const {
+    std::vector<std::pair<int, int>> res;
+    if (!rm_i.empty()) {
+      auto [i, j, offset] = rm_i.back();
+      if (offset == _rules.line_clear_run) {
+        j = 0;
+        offset = h;
+      }
+      for (int jj = j; jj < j + offset; ++jj) {
+        res.emplace_back(i, jj);
+      }
+    } else if (!rm_j.empty()) {
+      auto [i, j, offset] = rm_j.back();
+      if (offset == _rules.line_clear_run) {
+        i = 0;
+        offset = w;
+      }
+      for (int ii = i; ii < i + offset; ++ii) {
+        res.emplace_back(ii, j);
+      }
+    } else if (!rm_b.empty()) {
+      auto [i, j] = rm_b.back();
+      for (int m = -2; m < 3; ++m) {
+        for (int n = -2; n < 3; ++n) {
+          if (reasonable_coord(i + m, j + n)) {
+            res.emplace_back(i + m, j + n);
+          }
+        }
+      }
+    }
+    return res;
+  }
+  // The cascade after a swap, one group at a time. The next group is only
+  // looked for when the refill before it has been taken, so a consumer that
+  // stops early leaves the rest of the board untouched. The board must not
+  // be moved or changed elsewhere while the generator runs.
+  Generator<CascadeStep> cascade() {
+    while (true) {
+      if (!has_removals()) {
+        prepare_removals();
+      }
+      if (!has_removals()) {
+        co_return;
+      }
+      // Named, not temporaries: GCC 12 destroys a temporary in a co_yield
+      // operand twice.
+      CascadeStep removed{CascadeStep::removal, remove_one_thing()};
+      co_yield std::move(removed);
+      fill_up();
+      CascadeStep refilled{CascadeStep::refill, {}};
+      co_yield std::move(refilled);
+    }
+  }
+  // Runs the whole cascade, the way Game::step() does. Returns the number of
+  // removed groups. A board left without legal swaps is reshuffled; if none
+  // of its arrangements has one, it keeps its tiles and has_any_move()
+  // stays false.
+  int settle() {
+    int groups = 0;
+    for (const CascadeStep &s : cascade()) {
+      groups += s.kind == CascadeStep::removal;
+    }
+    if (!has_any_move()) {
+      reshuffle();
+    }
+    return groups;
+  }
+};
+
+template <size_t W, size_t H>
+inline bool operator==(const BasicBoard<W, H> &a, const BasicBoard<W, H> &b) {
+  if (a.w != b.w || a.h != b.h || a.tiles_hash != b.tiles_hash) {
+    return false;
+  }
+  for (int i = 0; i < a.w * a.h; ++i) {
+    if (a.board[i] != b.board[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+using Board = BasicBoard<>;
+using Board8 = BasicBoard<8, 8>;
+using Board10 = BasicBoard<10, 10>;
+using Board16 = BasicBoard<16, 16>;
+
+extern template class BasicBoard<>;
+extern template class BasicBoard<8, 8>;
+extern template class BasicBoard<10, 10>;
+extern template class BasicBoard<16, 16>;
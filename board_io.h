@@ -0,0 +1,83 @@
+#pragma once
+
+#include <istream>
+#include <ostream>
+
+#include "board.h"
+
+template <size_t W, size_t H>
+inline std::ostream &operator<<(std::ostream &of, const BasicBoard<W, H> &b) {
+  of << b.score << "\n"
+     << b.normals << "\n"
+     << b.longers << "\n"
+     << b.longests << "\n"
+     << b.crosses << "\n"
+     << b.w << " " << b.h << "\n";
+  for (int i = 0; i < b.w; ++i) {
+    for (int j = 0; j < b.h; ++j) {
+      of << b.at(i, j) << " ";
+    }
+    of << std::endl;
+  }
+  for (uint8_t bit : {1, 2}) {
+    of << std::count_if(std::begin(b.magic), std::end(b.magic),
+                        [bit](uint8_t m) { return m & bit; })
+       << "\n";
+    for (int i = 0; i < b.w; ++i) {
+      for (int j = 0; j < b.h; ++j) {
+        if (b.magic[i * b.h + j] & bit) {
+          of << i << " " << j << " ";
+        }
+      }
+    }
+    of << "\n";
+  }
+  return of;
+}
+
+// Reads a board written by operator<<. The board is only changed when all
+// of it reads and makes sense; otherwise failbit is set and it keeps what it
+// had.
+template <size_t W, size_t H>
+inline std::istream &operator>>(std::istream &in, BasicBoard<W, H> &b) {
+  // Up to the largest board the game makes, see TIAR2_SIZE.
+  constexpr long long max_cells = 4096ll * 4096;
+  long long w, h;
+  BasicBoard<W, H> r = b;
+  in >> r.score >> r.normals >> r.longers >> r.longests >> r.crosses >> w >> h;
+  if (!in || w < 1 || h < 1 || w * h > max_cells || !r.resize(w, h)) {
+    in.setstate(std::ios::failbit);
+    return in;
+  }
+  for (int i = 0; i < r.w; ++i) {
+    for (int j = 0; j < r.h; ++j) {
+      int v;
+      if (!(in >> v) || v < 1 || v > r.rules().colors) {
+        in.setstate(std::ios::failbit);
+        return in;
+      }
+      r.set(i, j, v);
+    }
+  }
+  r.update_moves();
+  for (uint8_t bit : {1, 2}) {
+    int s;
+    in >> s;
+    for (int k = 0; k < s && in; ++k) {
+      int i, j;
+      if (!(in >> i >> j) || !r.reasonable_coord(i, j)) {
+        in.setstate(std::ios::failbit);
+        return in;
+      }
+      if (bit == 1) {
+        r.set_magic(i, j, true);
+      } else {
+        r.set_magic2(i, j, true);
+      }
+    }
+  }
+  if (in) {
+    b = r;
+  }
+  return in;
+}
@@ -0,0 +1,96 @@
+// Decodes the game assets at build time and writes them into a header as raw
+// PCM and pixels, so that the game neither touches the filesystem nor decodes
+// anything at startup.
+//
+// Usage: embed_assets <output.h> <kind>:<name>:<file>...
+// where kind is "sound" (any format LoadWave understands) or "image" (any
+// format LoadImage understands, converted to R8G8B8A8).
+
+#include <cstdio>
+#include <fmt/format.h>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include <raylib.h>
+
+void write_bytes(std::ostream &out, const std::string &name,
+                 const unsigned char *data, size_t size) {
+  out << fmt::format("alignas(16) inline const unsigned char {}[] = {{", name);
+  for (size_t i = 0; i < size; ++i) {
+    out << (i % 24 == 0 ? "\n    " : "") << int(data[i]) << ",";
+  }
+  out << "\n};\n";
+}
+
+bool embed_sound(std::ostream &out, const std::string &name,
+                 const std::string &file) {
+  Wave wave = LoadWave(file.c_str());
+  if (wave.data == nullptr) {
+    return false;
+  }
+  size_t size = size_t(wave.frameCount) * wave.channels * wave.sampleSize / 8;
+  write_bytes(out, name + "_data", static_cast<unsigned char *>(wave.data),
+              size);
+  out << fmt::format("inline const Wave {}{{{}, {}, {}, {}, "
+                     "const_cast<unsigned char *>({}_data)}};\n\n",
+                     name, wave.frameCount, wave.sampleRate, wave.sampleSize,
+                     wave.channels, name);
+  UnloadWave(wave);
+  return true;
+}
+
+bool embed_image(std::ostream &out, const std::string &name,
+                 const std::string &file) {
+  Image image = LoadImage(file.c_str());
+  if (image.data == nullptr) {
+    return false;
+  }
+  ImageFormat(&image, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+  size_t size = size_t(image.width) * image.height * 4;
+  write_bytes(out, name + "_data", static_cast<unsigned char *>(image.data),
+              size);
+  out << fmt::format("inline const Image {}{{const_cast<unsigned char *>({}_"
+                     "data), {}, {}, 1, {}}};\n\n",
+                     name, name, image.width, image.height, image.format);
+  UnloadImage(image);
+  return true;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    std::cerr << "Usage: embed_assets <output.h> <kind>:<name>:<file>...\n";
+    return 1;
+  }
+  SetTraceLogLevel(LOG_WARNING);
+  std::string out_name = argv[1];
+  std::ofstream out(out_name + ".tmp");
+  out << "// Generated by embed_assets, do not edit.\n"
+         "#pragma once\n\n"
+         "#include <raylib.h>\n\n";
+  for (int i = 2; i < argc; ++i) {
+    std::string arg = argv[i];
+    auto first = arg.find(':');
+    auto second = arg.find(':', first + 1);
+    if (first == std::string::npos || second == std::string::npos) {
+      std::cerr << "Bad asset spec: " << arg << "\n";
+      return 1;
+    }
+    auto kind = arg.substr(0, first);
+    auto name = arg.substr(first + 1, second - first - 1);
+    auto file = arg.substr(second + 1);
+    bool ok = false;
+    if (kind == "sound") {
+      ok = embed_sound(out, name, file);
+    } else if (kind == "image") {
+      ok = embed_image(out, name, file);
+    }
+    if (!ok) {
+      std::cerr << "Can't embed " << arg << "\n";
+      return 1;
+    }
+  }
+  out.close();
+  std::rename((out_name + ".tmp").c_str(), out_name.c_str());
+  return 0;
+}
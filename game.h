@@ -0,0 +1,137 @@
+#pragma once
+
+#include <fmt/format.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "board.h"
+#include "board_io.h"
+
+template <typename B> class BasicGame {
+  std::string _name;
+  B _board;
+  B _old_board;
+  bool _work_board = false;
+  bool _first_work = true;
+  // Cascade of the move in progress; it refers to _board, so a game must
+  // stay where it is while a move runs.
+  Generator<CascadeStep> _cascade;
+  std::vector<std::tuple<int, int, int>> _removed_cells;
+
+  // Reshuffles a board left without legal swaps. When no arrangement of its
+  // tiles has one, the game goes on with fresh tiles instead.
+  void ensure_move() {
+    if (!_board.has_any_move() && !_board.reshuffle()) {
+      _board.generate();
+    }
+  }
+
+public:
+  BasicGame(size_t size, const Rules &rules = {})
+      : _board{size, size, rules}, _old_board{_board} {}
+  int counter = 0;
+  void new_game() {
+    counter = 0;
+    _work_board = false;
+    _cascade = {};
+    _board.generate();
+    _board.zero();
+  }
+  std::string save() { return save(_name, counter, _board); }
+  // The same for a copy of the state, e.g. made on another thread.
+  static std::string save(const std::string &name, int counter,
+                          const B &board) {
+    std::ostringstream save;
+    save << name << " " << counter << "\n";
+    save << board;
+    return save.str();
+  }
+  bool load() {
+    std::ifstream file("save.txt");
+    return file && load(file);
+  }
+  // Reads a game written by save(). A save that doesn't read leaves the
+  // game as it was and returns false.
+  bool load(std::istream &load) {
+    std::string name;
+    int moves;
+    if (!(load >> name >> moves >> _board)) {
+      return false;
+    }
+    _name = std::move(name);
+    counter = moves;
+    _work_board = false;
+    _cascade = {};
+    ensure_move();
+    return true;
+  }
+  void save_state() { _old_board = _board; }
+  bool check_state() const { return _old_board == _board; }
+  void restore_state() { _board = _old_board; }
+  B &board() { return _board; }
+  void seed(unsigned s) { _board.seed(s); }
+  std::string &name() { return _name; }
+  bool attempt_move(int row1, int col1, int row2, int col2) {
+    if (!_board.is_legal_swap(row1, col1, row2, col2)) {
+      return false;
+    }
+    _first_work = true;
+    _work_board = true;
+    save_state();
+    _board.swap(row1, col1, row2, col2);
+    _cascade = _board.cascade();
+    return true;
+  }
+  // The same, with the removals of the swapped board already found, e.g. by
+  // SwapSpeculator. They must have been found for this board and this swap.
+  bool attempt_move(int row1, int col1, int row2, int col2,
+                    Removals removals) {
+    if (!attempt_move(row1, col1, row2, col2)) {
+      return false;
+    }
+    _board.set_removals(std::move(removals));
+    return true;
+  }
+  // Removes and refills one group of the current move. The call after the
+  // last group finishes the move and returns nothing.
+  std::vector<std::tuple<int, int, int>> step() {
+    std::vector<std::tuple<int, int, int>> res;
+    if (!_work_board) {
+      return res;
+    }
+    if (_cascade.next()) {
+      res = std::move(_cascade.value().cells);
+      _cascade.next();
+      _first_work = false;
+      return res;
+    }
+    _cascade = {};
+    if (_first_work) {
+      restore_state();
+    } else {
+      counter += 1;
+      ensure_move();
+    }
+    _work_board = false;
+    return res;
+  }
+  // Runs the current move to the end, returns the number of removal steps.
+  int settle() {
+    int steps = 0;
+    while (_work_board) {
+      if (!step().empty()) {
+        steps += 1;
+      }
+    }
+    return steps;
+  }
+  bool is_finished() { return counter == _board.rules().move_limit; }
+  bool is_processing() { return _work_board; }
+  std::string game_stats() {
+    return fmt::format("Moves: {}\nScore: {}\nTrios: {}\nQuartets: "
+                       "{}\nQuintets: {}\nCrosses: {}",
+                       counter, _board.score, _board.normals, _board.longers,
+                       _board.longests, _board.crosses);
+  }
+};
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <coroutine>
+#include <optional>
+#include <utility>
+
+// Lazy sequence produced by a coroutine. Nothing runs until the first value
+// is asked for, and every next() runs the coroutine only up to its next
+// co_yield.
+template <typename T> class Generator {
+public:
+  struct promise_type;
+  using Handle = std::coroutine_handle<promise_type>;
+  struct promise_type {
+    std::optional<T> value;
+    Generator get_return_object() {
+      return Generator{Handle::from_promise(*this)};
+    }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    std::suspend_always final_suspend() noexcept { return {}; }
+    std::suspend_always yield_value(T &&v) {
+      value = std::move(v);
+      return {};
+    }
+    std::suspend_always yield_value(const T &v) {
+      value = v;
+      return {};
+    }
+    void return_void() { value.reset(); }
+    void unhandled_exception() { throw; }
+  };
+
+  struct sentinel {};
+  struct iterator {
+    Generator *g;
+    T &operator*() const { return g->value(); }
+    iterator &operator++() {
+      g->next();
+      return *this;
+    }
+    bool operator==(sentinel) const { return g->done(); }
+  };
+
+  Generator() = default;
+  Generator(Generator &&o) noexcept : _h{std::exchange(o._h, {})} {}
+  Generator &operator=(Generator &&o) noexcept {
+    if (this != &o) {
+      reset();
+      _h = std::exchange(o._h, {});
+    }
+    return *this;
+  }
+  ~Generator() { reset(); }
+
+  // Runs up to the next value, false once the coroutine has returned.
+  bool next() {
+    if (done()) {
+      return false;
+    }
+    _h.resume();
+    return !_h.done();
+  }
+  // The value of the last successful next().
+  T &value() const { return *_h.promise().value; }
+  // Whether there is no coroutine or it has returned.
+  bool done() const { return !_h || _h.done(); }
+  iterator begin() {
+    next();
+    return {this};
+  }
+  sentinel end() const { return {}; }
+
+private:
+  explicit Generator(Handle h) : _h{h} {}
+  void reset() {
+    if (_h) {
+      _h.destroy();
+      _h = {};
+    }
+  }
+
+  Handle _h;
+};
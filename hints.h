@@ -0,0 +1,140 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "board.h"
+#include "rule_set.h"
+
+// Cells of one position that take part in a move pattern.
+struct Hints {
+  uint64_t hash = 0;
+  int w = 0;
+  int h = 0;
+  // 1 - part of a long pattern, 2 - part of a three pattern, see
+  // rule_set.h.
+  std::vector<uint8_t> marks;
+  bool is_matched(int i, int j) const { return marks[i * h + j] & 1; }
+  bool is_three(int i, int j) const { return marks[i * h + j] & 2; }
+};
+
+// Finds hints on a background thread, from a copy of the tiles, so that
+// neither the cascade nor the render loop waits for the pattern scan. A new
+// request cancels the one in progress; results are published whole.
+class HintWorker {
+  std::mutex _mutex;
+  std::condition_variable _cv;
+  Hints _job;
+  std::vector<int> _tiles;
+  bool _has_job = false;
+  bool _stop = false;
+  uint64_t _requested = 0;
+  std::atomic<uint64_t> _generation = 0;
+  std::atomic<std::shared_ptr<const Hints>> _latest;
+  // Patterns of the rule set, and their tables for the last board size.
+  std::vector<Pattern> _longs;
+  std::vector<Pattern> _threes;
+  PatternTable _long_table;
+  PatternTable _three_table;
+  std::thread _thread;
+
+  // Marks cells of every placement in the table, giving up as soon as a
+  // newer request arrives.
+  bool scan(Hints &hints, const PatternTable &table, uint8_t mark,
+            const std::vector<int> &tiles, uint64_t generation) const {
+    for (size_t k = 0; k < table.shape_count(); ++k) {
+      if (_generation != generation) {
+        return false;
+      }
+      table.scan(k, tiles.data(), [&](const int *first, const int *last,
+                                      int cell) {
+        for (const int *o = first; o != last; ++o) {
+          hints.marks[cell + *o] |= mark;
+        }
+      });
+    }
+    return true;
+  }
+
+  void run() {
+    std::unique_lock lock(_mutex);
+    while (true) {
+      _cv.wait(lock, [this] { return _stop || _has_job; });
+      if (_stop) {
+        return;
+      }
+      Hints hints = std::move(_job);
+      auto tiles = std::move(_tiles);
+      _has_job = false;
+      uint64_t generation = _generation;
+      lock.unlock();
+      hints.marks.assign(tiles.size(), 0);
+      if (_long_table.width() != hints.w || _long_table.height() != hints.h) {
+        _long_table = PatternTable(_longs, hints.w, hints.h);
+        _three_table = PatternTable(_threes, hints.w, hints.h);
+      }
+      if (scan(hints, _long_table, 1, tiles, generation) &&
+          scan(hints, _three_table, 2, tiles, generation) &&
+          _generation == generation) {
+        _latest = std::make_shared<const Hints>(std::move(hints));
+      }
+      lock.lock();
+    }
+  }
+
+public:
+  explicit HintWorker(const RuleSet &set = {})
+      : _longs{set.longs}, _threes{set.threes}, _thread{[this] { run(); }} {}
+  ~HintWorker() {
+    {
+      std::lock_guard lock(_mutex);
+      _stop = true;
+    }
+    _cv.notify_all();
+    _thread.join();
+  }
+  // Starts looking for hints on b, unless they are already known or being
+  // looked for.
+  template <typename B> void request(const B &b) {
+    uint64_t hash = b.hash();
+    auto latest = _latest.load();
+    if (hash == _requested || (latest && latest->hash == hash)) {
+      return;
+    }
+    std::vector<int> tiles;
+    tiles.reserve(b.width() * b.height());
+    for (int i = 0; i < b.width(); ++i) {
+      for (int j = 0; j < b.height(); ++j) {
+        tiles.push_back(b.at(i, j));
+      }
+    }
+    {
+      std::lock_guard lock(_mutex);
+      _job = Hints{hash, b.width(), b.height()};
+      _tiles = std::move(tiles);
+      _has_job = true;
+      _requested = hash;
+      _generation += 1;
+    }
+    _cv.notify_all();
+  }
+  // Drops the request in progress, if any.
+  void cancel() {
+    std::lock_guard lock(_mutex);
+    _has_job = false;
+    _requested = 0;
+    _generation += 1;
+  }
+  // The newest published hints, for whatever position they were made.
+  std::shared_ptr<const Hints> latest() const { return _latest.load(); }
+  // Whether a request is still waiting for its result.
+  bool pending() const {
+    auto latest = _latest.load();
+    return _requested != 0 && !(latest && latest->hash == _requested);
+  }
+};
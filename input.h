@@ -0,0 +1,131 @@
+#pragma once
+
+// Per-frame input of the game loop, read from raylib or from a recording,
+// see recording.h for the format.
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <raylib.h>
+
+#include "recording.h"
+
+class Input {
+  std::ofstream _record;
+  std::ifstream _replay;
+  bool _replaying = false;
+  FrameInput _frame;
+  GameEvent _event;
+  size_t _next_key = 0;
+  size_t _next_char = 0;
+
+  // Only the left and the right button are kept.
+  static int button_bits(int button) {
+    return button == MOUSE_BUTTON_RIGHT ? 3 : 0;
+  }
+
+public:
+  // Writes the session and every following frame and game event to path.
+  bool record(const char *path, const Session &s) {
+    _record.open(path, std::ios::binary | std::ios::trunc);
+    recording::write_session(_record, s);
+    return bool(_record);
+  }
+  // Reads the session from path; frames then come from the file.
+  bool replay(const char *path, Session &s) {
+    _replay.open(path, std::ios::binary);
+    if (!recording::read_session(_replay, s)) {
+      return false;
+    }
+    _replaying = true;
+    return true;
+  }
+  bool is_replaying() const { return _replaying; }
+
+  // Notes what the current frame did to the game, when recording.
+  void event(const GameEvent &e) {
+    if (_record.is_open()) {
+      recording::write_event(_record, e);
+    }
+  }
+
+  // Takes the input of the next loop iteration. Returns false when a replay
+  // has no frames left.
+  bool next_frame() {
+    FrameInput &f = _frame;
+    _next_key = 0;
+    _next_char = 0;
+    if (_replaying) {
+      // The replayed game makes the same events itself.
+      while (true) {
+        switch (recording::read_record(_replay, f, _event)) {
+        case recording::Record::end:
+          return false;
+        case recording::Record::frame:
+          return true;
+        case recording::Record::event:
+          break;
+        }
+      }
+    }
+    f.keys.clear();
+    f.chars.clear();
+    f.width = GetRenderWidth();
+    f.height = GetRenderHeight();
+    f.resized = IsWindowResized();
+    Vector2 mouse = GetMousePosition();
+    Vector2 delta = GetMouseDelta();
+    f.mouse_x = mouse.x;
+    f.mouse_y = mouse.y;
+    f.delta_x = delta.x;
+    f.delta_y = delta.y;
+    f.wheel = GetMouseWheelMove();
+    f.buttons = 0;
+    for (int button : {MOUSE_BUTTON_LEFT, MOUSE_BUTTON_RIGHT}) {
+      int bits = IsMouseButtonDown(button) | IsMouseButtonPressed(button) << 1 |
+                 IsMouseButtonReleased(button) << 2;
+      f.buttons |= bits << button_bits(button);
+    }
+    while (int key = GetKeyPressed()) {
+      f.keys.push_back(key);
+    }
+    while (int c = GetCharPressed()) {
+      f.chars.push_back(c);
+    }
+    if (_record.is_open()) {
+      recording::write_frame(_record, f);
+    }
+    return true;
+  }
+
+  // The same questions the loop would ask raylib, about the current frame.
+  int width() const { return _frame.width; }
+  int height() const { return _frame.height; }
+  bool window_resized() const { return _frame.resized; }
+  Vector2 mouse() const { return {_frame.mouse_x, _frame.mouse_y}; }
+  Vector2 mouse_delta() const { return {_frame.delta_x, _frame.delta_y}; }
+  float wheel() const { return _frame.wheel; }
+  bool button_down(int button) const {
+    return _frame.buttons >> button_bits(button) & 1;
+  }
+  bool button_pressed(int button) const {
+    return _frame.buttons >> button_bits(button) & 2;
+  }
+  bool button_released(int button) const {
+    return _frame.buttons >> button_bits(button) & 4;
+  }
+  bool key_pressed(int key) const {
+    return std::find(_frame.keys.begin(), _frame.keys.end(), key) !=
+           _frame.keys.end();
+  }
+  // Pressed keys and typed characters one at a time, 0 when there are no
+  // more, like GetKeyPressed() and GetCharPressed().
+  int next_key() {
+    return _next_key < _frame.keys.size() ? _frame.keys[_next_key++] : 0;
+  }
+  int next_char() {
+    return _next_char < _frame.chars.size() ? _frame.chars[_next_char++] : 0;
+  }
+};
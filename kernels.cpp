@@ -0,0 +1,152 @@
+#include "kernels.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <string_view>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define TIAR2_X86_DISPATCH 1
+#define TIAR2_INLINE [[gnu::always_inline]] inline
+#else
+#define TIAR2_INLINE inline
+#endif
+
+namespace {
+
+// Plain loops, vectorized by the compiler for whatever instruction set the
+// function they are inlined into targets.
+
+TIAR2_INLINE void run_lengths(const uint8_t *t, const uint8_t *next,
+                              const uint8_t *next_run, uint8_t *run,
+                              size_t n) {
+  for (size_t b = 0; b < n; ++b) {
+    run[b] = (t[b] == next[b]) * next_run[b] + 1;
+  }
+}
+
+TIAR2_INLINE void run_hits(const uint8_t *rh, const uint8_t *rv,
+                           const uint8_t *want, uint8_t *hit, size_t n) {
+  for (size_t b = 0; b < n; ++b) {
+    hit[b] = ((rh[b] > 2) | (rv[b] > 2) << 1) * want[b];
+  }
+}
+
+TIAR2_INLINE void zeros(const uint8_t *t, uint8_t *hit, size_t n) {
+  for (size_t b = 0; b < n; ++b) {
+    hit[b] = t[b] == 0;
+  }
+}
+
+// Whether colour c at the centre of arms a completes a run of three.
+TIAR2_INLINE uint8_t runs(const uint8_t *const *a, size_t b, uint8_t c) {
+  uint8_t u1 = a[0][b] == c;
+  uint8_t u2 = u1 & (a[1][b] == c);
+  uint8_t d1 = a[2][b] == c;
+  uint8_t d2 = d1 & (a[3][b] == c);
+  uint8_t l1 = a[4][b] == c;
+  uint8_t l2 = l1 & (a[5][b] == c);
+  uint8_t r1 = a[6][b] == c;
+  uint8_t r2 = r1 & (a[7][b] == c);
+  return u2 | d2 | (u1 & d1) | l2 | r2 | (l1 & r1);
+}
+
+// Results go through a stack buffer first, which can't alias the inputs, so
+// that the compiler doesn't have to check eighteen pointers against lm.
+TIAR2_INLINE void mark_swaps(const uint8_t *a, const uint8_t *o,
+                             const uint8_t *const *x, const uint8_t *const *y,
+                             uint8_t dir, uint8_t *lm, size_t b0, size_t b1) {
+  const uint8_t *xs[8];
+  const uint8_t *ys[8];
+  std::copy_n(x, 8, xs);
+  std::copy_n(y, 8, ys);
+  constexpr size_t chunk = 64;
+  uint8_t ok[chunk];
+  for (size_t c = b0; c < b1; c += chunk) {
+    size_t len = std::min(chunk, b1 - c);
+    for (size_t k = 0; k < len; ++k) {
+      size_t b = c + k;
+      uint8_t ta = a[b];
+      uint8_t tb = o[b];
+      ok[k] = (ta != tb) & (((tb != 0) & runs(xs, b, tb)) |
+                            ((ta != 0) & runs(ys, b, ta)));
+    }
+    for (size_t k = 0; k < len; ++k) {
+      lm[c + k] |= ok[k] * dir;
+    }
+  }
+}
+
+// One copy of every kernel per instruction set.
+#define TIAR2_LANE_KERNELS(name, isa, target)                                \
+  target void run_lengths_##name(const uint8_t *t, const uint8_t *next,      \
+                                 const uint8_t *next_run, uint8_t *run,      \
+                                 size_t n) {                                 \
+    run_lengths(t, next, next_run, run, n);                                  \
+  }                                                                          \
+  target void run_hits_##name(const uint8_t *rh, const uint8_t *rv,          \
+                              const uint8_t *want, uint8_t *hit, size_t n) { \
+    run_hits(rh, rv, want, hit, n);                                          \
+  }                                                                          \
+  target void zeros_##name(const uint8_t *t, uint8_t *hit, size_t n) {       \
+    zeros(t, hit, n);                                                        \
+  }                                                                          \
+  target void mark_swaps_##name(const uint8_t *a, const uint8_t *o,          \
+                                const uint8_t *const *x,                     \
+                                const uint8_t *const *y, uint8_t dir,        \
+                                uint8_t *lm, size_t b0, size_t b1) {         \
+    mark_swaps(a, o, x, y, dir, lm, b0, b1);                                 \
+  }                                                                          \
+  constexpr LaneKernels name##_kernels{isa, run_lengths_##name,              \
+                                       run_hits_##name, zeros_##name,        \
+                                       mark_swaps_##name};
+
+TIAR2_LANE_KERNELS(baseline, "baseline", )
+#ifdef TIAR2_X86_DISPATCH
+TIAR2_LANE_KERNELS(sse42, "sse4.2", [[gnu::target("sse4.2")]])
+TIAR2_LANE_KERNELS(avx2, "avx2", [[gnu::target("avx2")]])
+TIAR2_LANE_KERNELS(avx512, "avx512",
+                   [[gnu::target("avx512f,avx512bw,avx512vl,"
+                                 "prefer-vector-width=512")]])
+#endif
+
+#undef TIAR2_LANE_KERNELS
+
+const LaneKernels &select_kernels() {
+  // Fastest first.
+  const LaneKernels *supported[4];
+  int count = 0;
+#ifdef TIAR2_X86_DISPATCH
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+      __builtin_cpu_supports("avx512vl")) {
+    supported[count++] = &avx512_kernels;
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    supported[count++] = &avx2_kernels;
+  }
+  if (__builtin_cpu_supports("sse4.2")) {
+    supported[count++] = &sse42_kernels;
+  }
+#endif
+  supported[count++] = &baseline_kernels;
+  const char *wanted = std::getenv("TIAR2_ISA");
+  if (wanted == nullptr || *wanted == 0) {
+    return *supported[0];
+  }
+  for (int k = 0; k < count; ++k) {
+    if (std::string_view(supported[k]->isa) == wanted) {
+      return *supported[k];
+    }
+  }
+  std::cerr << "TIAR2_ISA=" << wanted << " is not supported here, using "
+            << supported[0]->isa << "\n";
+  return *supported[0];
+}
+
+} // namespace
+
+const LaneKernels &lane_kernels() {
+  static const LaneKernels &kernels = select_kernels();
+  return kernels;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Byte-lane loops of BoardBatch. The same source is compiled for several
+// instruction sets and the best one the CPU supports is picked on first use;
+// setting TIAR2_ISA to baseline, sse4.2, avx2 or avx512 picks a lower one.
+struct LaneKernels {
+  const char *isa;
+  // run[b] = t[b] == next[b] ? next_run[b] + 1 : 1
+  void (*run_lengths)(const uint8_t *t, const uint8_t *next,
+                      const uint8_t *next_run, uint8_t *run, size_t n);
+  // hit[b] = want[b] ? (rh[b] > 2) | (rv[b] > 2) << 1 : 0
+  void (*run_hits)(const uint8_t *rh, const uint8_t *rv, const uint8_t *want,
+                   uint8_t *hit, size_t n);
+  // hit[b] = t[b] == 0
+  void (*zeros)(const uint8_t *t, uint8_t *hit, size_t n);
+  // Sets dir in lm[b] for b0 <= b < b1 where swapping a and o completes a
+  // run. x and y are the two cells on each side of a and o after the swap,
+  // along both axes: up, down, left and right, nearest first.
+  void (*mark_swaps)(const uint8_t *a, const uint8_t *o,
+                     const uint8_t *const *x, const uint8_t *const *y,
+                     uint8_t dir, uint8_t *lm, size_t b0, size_t b1);
+};
+
+const LaneKernels &lane_kernels();
@@ -0,0 +1,202 @@
+#pragma once
+
+// Live board export for observers in other processes: overlays, dashboards,
+// bots. The game writes a LiveSegment into POSIX shared memory whenever the
+// board changes; readers map the same name read-only and call read_live().
+// The export is off unless TIAR2_LIVE names the segment, e.g. /tiar2.
+//
+// The segment is a seqlock: seq is odd while the game writes, and a reader
+// keeps its copy only if seq was even and unchanged around it. The game
+// never waits for readers, and readers never block it.
+//
+// Boards of more than live_max_cells cells are published without their
+// cells: status says so, and width, height and the counters stay current.
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#define TIAR2_LIVE_EXPORT 1
+#endif
+
+constexpr uint32_t live_magic = 0x4c423254; // "T2BL"
+constexpr uint32_t live_version = 2;
+constexpr int live_max_cells = 64 * 64;
+
+enum LiveStatus : int32_t {
+  LIVE_OK = 0,
+  // The board doesn't fit: tiles and magic are left as they were and
+  // event_count is 0.
+  LIVE_TOO_BIG = 1,
+};
+
+struct LiveState {
+  int32_t status;
+  int32_t width;
+  int32_t height;
+  int32_t moves;
+  int32_t score;
+  int32_t normals;
+  int32_t longers;
+  int32_t longests;
+  int32_t crosses;
+  // Whether a move is being played out.
+  int32_t processing;
+  // Removal steps published so far; events holds the cells of the last one.
+  uint32_t removal_steps;
+  uint32_t event_count;
+  // Row-major, width * height cells used.
+  uint8_t tiles[live_max_cells];
+  // 1 - magic, 2 - bonus.
+  uint8_t magic[live_max_cells];
+  struct Event {
+    uint8_t row;
+    uint8_t col;
+    uint8_t tile;
+    uint8_t pad;
+  } events[live_max_cells];
+};
+
+struct LiveSegment {
+  uint32_t magic;
+  uint32_t version;
+  std::atomic<uint32_t> seq;
+  LiveState state;
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free);
+
+// Copies a consistent snapshot out of a mapped segment. Returns false if the
+// segment isn't a live board or the game kept writing for all attempts.
+inline bool read_live(const LiveSegment *seg, LiveState &out,
+                      int attempts = 1000) {
+  if (seg->magic != live_magic || seg->version != live_version) {
+    return false;
+  }
+  for (int a = 0; a < attempts; ++a) {
+    uint32_t before = seg->seq.load(std::memory_order_acquire);
+    if (before & 1) {
+      continue;
+    }
+    std::memcpy(&out, &seg->state, sizeof(out));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (seg->seq.load(std::memory_order_relaxed) == before) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// The writing side, owned by the game. Without a name, or where POSIX shared
+// memory isn't available, every call does nothing.
+class LiveExport {
+  std::string _name;
+  LiveSegment *_seg = nullptr;
+  std::vector<std::tuple<int, int, int>> _events;
+  uint32_t _removal_steps = 0;
+  bool _dirty = true;
+  uint64_t _last_hash = 0;
+  int _last_moves = -1;
+  bool _last_processing = false;
+
+public:
+  explicit LiveExport(const char *name) {
+#ifdef TIAR2_LIVE_EXPORT
+    if (name == nullptr || *name == 0) {
+      return;
+    }
+    int fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+    if (fd < 0) {
+      return;
+    }
+    void *p = MAP_FAILED;
+    if (ftruncate(fd, sizeof(LiveSegment)) == 0) {
+      p = mmap(nullptr, sizeof(LiveSegment), PROT_READ | PROT_WRITE,
+               MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (p == MAP_FAILED) {
+      shm_unlink(name);
+      return;
+    }
+    _name = name;
+    _seg = new (p) LiveSegment{};
+    _seg->version = live_version;
+    _seg->magic = live_magic;
+#endif
+  }
+  ~LiveExport() {
+#ifdef TIAR2_LIVE_EXPORT
+    if (_seg != nullptr) {
+      munmap(_seg, sizeof(LiveSegment));
+      shm_unlink(_name.c_str());
+    }
+#endif
+  }
+  LiveExport(const LiveExport &) = delete;
+  LiveExport &operator=(const LiveExport &) = delete;
+  bool is_open() const { return _seg != nullptr; }
+  // Cells (row, column, tile) of a removal step, sent with the next publish.
+  void removed(const std::vector<std::tuple<int, int, int>> &cells) {
+    if (_seg == nullptr || cells.empty()) {
+      return;
+    }
+    _events = cells;
+    _removal_steps += 1;
+    _dirty = true;
+  }
+  // Writes the board out if anything changed since the last call.
+  template <typename G> void publish(G &game) {
+    if (_seg == nullptr) {
+      return;
+    }
+    auto &b = game.board();
+    if (!_dirty && b.hash() == _last_hash && game.counter == _last_moves &&
+        game.is_processing() == _last_processing) {
+      return;
+    }
+    _dirty = false;
+    _last_hash = b.hash();
+    _last_moves = game.counter;
+    _last_processing = game.is_processing();
+    int w = b.width();
+    int h = b.height();
+    bool fits = w * h <= live_max_cells;
+    uint32_t seq = _seg->seq.load(std::memory_order_relaxed);
+    _seg->seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    LiveState &s = _seg->state;
+    s.status = fits ? LIVE_OK : LIVE_TOO_BIG;
+    s.width = w;
+    s.height = h;
+    s.moves = game.counter;
+    s.score = b.score;
+    s.normals = b.normals;
+    s.longers = b.longers;
+    s.longests = b.longests;
+    s.crosses = b.crosses;
+    s.processing = game.is_processing();
+    for (int i = 0; i < w && fits; ++i) {
+      for (int j = 0; j < h; ++j) {
+        s.tiles[i * h + j] = b.at(i, j);
+        s.magic[i * h + j] = b.is_magic(i, j) | b.is_magic2(i, j) << 1;
+      }
+    }
+    s.removal_steps = _removal_steps;
+    s.event_count = fits ? std::min<size_t>(_events.size(), live_max_cells) : 0;
+    for (size_t k = 0; k < s.event_count; ++k) {
+      auto [i, j, tile] = _events[k];
+      s.events[k] = {uint8_t(i), uint8_t(j), uint8_t(tile), 0};
+    }
+    _seg->seq.store(seq + 2, std::memory_order_release);
+  }
+};
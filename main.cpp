@@ -1,667 +1,130 @@
 #include <algorithm>
+#include <array>
 #include <chrono>
 #include <cmath>
+#include <condition_variable>
+#include <filesystem>
 #include <fmt/format.h>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <map>
+#include <mutex>
 #include <random>
 #include <set>
+#include <sstream>
+#include <string_view>
+#include <thread>
 #include <vector>
 
 #include <raylib.h>
 #include <raymath.h>
 
-using namespace std;
-
-struct Point {
-  int _x = 0;
-  int _y = 0;
-  int y() const { return _y; }
-  int x() const { return _x; }
-  void setX(int x) { _x = x; }
-  void setY(int y) { _y = y; }
-  friend Point operator-(const Point &a, const Point &b);
-  Point &operator-=(const Point &a) {
-    *this = *this - a;
-    return *this;
-  }
-};
-
-Point operator-(const Point &a, const Point &b) {
-  return Point{a._x - b._x, a._y - b._y};
-}
-
-using Pattern = std::vector<Point>;
-
-struct SizedPattern {
-  Pattern pat;
-  int w;
-  int h;
-};
-
-inline Pattern shift(Pattern &p) {
-  int minX = std::numeric_limits<int>::max();
-  int minY = std::numeric_limits<int>::max();
-  for (Point &pt : p) {
-    minX = std::min(pt.x(), minX);
-    minY = std::min(pt.y(), minY);
-  }
-  Pattern res(p);
-  for (Point &pt : res) {
-    pt -= Point{minX, minY};
-  }
-  return res;
-}
-
-inline std::vector<Pattern> rotations(Pattern &p) {
-  std::vector<Pattern> res(4);
-  res[0] = p;
-  for (int i = 1; i < 4; ++i) {
-    Pattern rotated(p.size());
-    for (auto j = 0u; j < p.size(); ++j) {
-      rotated[j].setX(res[i - 1][j].y());
-      rotated[j].setY(-res[i - 1][j].x());
-    }
-    res[i] = shift(rotated);
-  }
-  return res;
-}
-
-inline Pattern mirrored(Pattern &p) {
-  Pattern m(p);
-  for (auto i = 0u; i < p.size(); ++i) {
-    m[i].setY(-p[i].y());
-  }
-  return shift(m);
-}
-
-inline SizedPattern sized(Pattern &p) {
-  SizedPattern res;
-  res.pat = p;
-  int maxX = std::numeric_limits<int>::min();
-  int maxY = std::numeric_limits<int>::min();
-  for (Point &pt : p) {
-    maxX = std::max(pt.x(), maxX);
-    maxY = std::max(pt.y(), maxY);
-  }
-  res.w = maxX + 1;
-  res.h = maxY + 1;
-  return res;
-}
-
-inline std::vector<SizedPattern> generate(Pattern p, bool symmetric = false) {
-  auto s = rotations(p);
-  std::vector<Pattern> res1;
-  if (!symmetric) {
-    Pattern m = mirrored(p);
-    auto r = rotations(m);
-    res1.reserve(s.size() + r.size());
-    std::copy(r.begin(), r.end(), std::back_inserter(res1));
-  } else {
-    res1.reserve(s.size());
-  }
-  std::copy(s.begin(), s.end(), std::back_inserter(res1));
-  std::vector<SizedPattern> res2;
-  res2.reserve(res1.size());
-  std::transform(res1.begin(), res1.end(), std::back_inserter(res2),
-                 [](Pattern &pt) { return sized(pt); });
-  return res2;
-}
+#include "alloc_tracker.h"
+#include "assets.h"
+#include "board.h"
+#include "board_io.h"
+#include "game.h"
+#include "hints.h"
+#include "input.h"
+#include "live.h"
+#include "rule_set.h"
+#include "speculate.h"
 
-const Pattern three_p_1 = {{0, 0}, {1, 1}, {0, 2}};
-const Pattern three_p_2 = {{1, 0}, {0, 1}, {0, 2}};
-const Pattern three_p_3 = {{0, 0}, {0, 1}, {0, 3}};
-const Pattern four_p = {{0, 0}, {1, 1}, {0, 2}, {0, 3}};
-const Pattern five_p_1 = {{0, 0}, {0, 1}, {1, 2}, {0, 3}, {0, 4}};
-const Pattern five_p_2 = {{0, 0}, {1, 1}, {1, 2}, {2, 0}, {3, 0}};
-
-const std::vector<SizedPattern> threes1 = generate(three_p_1);
-const std::vector<SizedPattern> threes2 = generate(three_p_2);
-const std::vector<SizedPattern> threes3 = generate(three_p_3);
-const std::vector<SizedPattern> fours = generate(four_p);
-const std::vector<SizedPattern> fives1 = generate(five_p_1);
-const std::vector<SizedPattern> fives2 = generate(five_p_2);
-const std::vector<SizedPattern> threes = []() {
-  std::vector<SizedPattern> res;
-  res.reserve(threes1.size() + threes2.size() + threes3.size());
-  res.insert(res.end(), threes1.begin(), threes1.end());
-  res.insert(res.end(), threes2.begin(), threes2.end());
-  res.insert(res.end(), threes3.begin(), threes3.end());
-  return res;
-}();
-const std::vector<SizedPattern> patterns = []() {
-  std::vector<SizedPattern> res;
-  res.reserve(fours.size() + fives1.size() + fives2.size());
-  res.insert(res.end(), fours.begin(), fours.end());
-  res.insert(res.end(), fives1.begin(), fives1.end());
-  res.insert(res.end(), fives2.begin(), fives2.end());
-  return res;
-}();
+using namespace std;
 
-class Board {
-  std::vector<int> board;
-  std::default_random_engine e1{static_cast<unsigned>(
-      std::chrono::system_clock::now().time_since_epoch().count())};
-  std::uniform_int_distribution<int> uniform_dist{1, 6};
-  std::uniform_int_distribution<int> uniform_dist_2;
-  std::uniform_int_distribution<int> uniform_dist_3;
-  std::uniform_int_distribution<int> coin{1, 42};
-  std::uniform_int_distribution<int> coin2{1, 69};
 
-  size_t w;
-  size_t h;
-  std::set<std::pair<int, int>> matched_patterns;
-  std::set<std::pair<int, int>> matched_threes;
-  std::set<std::pair<int, int>> magic_tiles;
-  std::set<std::pair<int, int>> magic_tiles2;
-  std::vector<std::tuple<int, int, int>> rm_i;
-  std::vector<std::tuple<int, int, int>> rm_j;
-  std::vector<std::pair<int, int>> rm_b;
+// Writes files on a background thread. Every file is written to a temporary
+// next to it and renamed over the target, and a newer request for a path
+// replaces the pending one. The text can also be made on that thread.
+class FileWriter {
+  std::mutex _mutex;
+  std::condition_variable _cv;
+  std::map<std::string, std::function<std::string()>> _pending;
+  bool _busy = false;
+  bool _stop = false;
+  std::thread _thread;
 
-public:
-  int width() { return w; }
-  int height() { return h; }
-  int score{};
-  int normals{};
-  int longers{};
-  int longests{};
-  int crosses{};
-  Board(size_t _w, size_t _h) : w{_w}, h{_h} {
-    board.resize(w * h);
-    std::fill(std::begin(board), std::end(board), 0);
-    uniform_dist_2 = std::uniform_int_distribution<int>(0, w - 1);
-    uniform_dist_3 = std::uniform_int_distribution<int>(0, h - 1);
-  }
-  Board(const Board &b) {
-    w = b.w;
-    h = b.h;
-    board = b.board;
-    score = b.score;
-    matched_patterns = b.matched_patterns;
-    magic_tiles = b.magic_tiles;
-    magic_tiles2 = b.magic_tiles2;
-  }
-  Board operator=(const Board &b) {
-    w = b.w;
-    h = b.h;
-    board = b.board;
-    score = b.score;
-    matched_patterns = b.matched_patterns;
-    magic_tiles = b.magic_tiles;
-    magic_tiles2 = b.magic_tiles2;
-    return *this;
-  }
-  friend bool operator==(const Board &a, const Board &b);
-  friend std::ostream &operator<<(std::ostream &of, const Board &b);
-  friend std::istream &operator>>(std::istream &in, Board &b);
-  bool match_pattern(int x, int y, const SizedPattern &p) {
-    int color = at(x + p.pat[0].x(), y + p.pat[0].y());
-    for (auto i = 1u; i < p.pat.size(); ++i) {
-      if (color != at(x + p.pat[i].x(), y + p.pat[i].y())) {
-        return false;
+  void run() {
+    std::unique_lock lock(_mutex);
+    while (true) {
+      _cv.wait(lock, [this] { return _stop || !_pending.empty(); });
+      if (_pending.empty()) {
+        return;
       }
-    }
-    return true;
-  }
-  void match_patterns() {
-    matched_patterns.clear();
-    for (const SizedPattern &sp : patterns) {
-      for (int i = 0; i <= w - sp.w; ++i) {
-        for (int j = 0; j <= h - sp.h; ++j) {
-          if (match_pattern(i, j, sp)) {
-            for (const Point &p : sp.pat) {
-              matched_patterns.insert({i + p.x(), j + p.y()});
-            }
+      auto files = std::move(_pending);
+      _pending.clear();
+      _busy = true;
+      lock.unlock();
+      for (auto &[path, make_text] : files) {
+        auto tmp = path + ".tmp";
+        {
+          std::ofstream output(tmp, std::ios::binary | std::ios::trunc);
+          output << make_text();
+          if (!output) {
+            continue;
           }
         }
+        std::error_code ec;
+        std::filesystem::rename(tmp, path, ec);
       }
+      lock.lock();
+      _busy = false;
+      _cv.notify_all();
     }
   }
-  bool is_matched(int x, int y) { return matched_patterns.contains({x, y}); }
-  bool is_magic(int x, int y) { return magic_tiles.contains({x, y}); }
-  bool is_magic2(int x, int y) { return magic_tiles2.contains({x, y}); }
-  void swap(int x1, int y1, int x2, int y2) {
-    auto tmp = at(x1, y1);
-    at(x1, y1) = at(x2, y2);
-    at(x2, y2) = tmp;
-
-    if (is_magic(x1, y1)) {
-      magic_tiles.erase({x1, y1});
-      magic_tiles.insert({x2, y2});
-    }
-
-    if (is_magic(x2, y2)) {
-      magic_tiles.erase({x2, y2});
-      magic_tiles.insert({x1, y1});
-    }
-
-    if (is_magic2(x1, y1)) {
-      magic_tiles2.erase({x1, y1});
-      magic_tiles2.insert({x2, y2});
-    }
 
-    if (is_magic2(x2, y2)) {
-      magic_tiles2.erase({x2, y2});
-      magic_tiles2.insert({x1, y1});
-    }
-  }
-  void fill() {
-    for (auto &x : board) {
-      x = uniform_dist(e1);
-    }
-  }
-  int &at(int a, int b) { return board[a * h + b]; }
-  int at(int a, int b) const { return board[a * h + b]; }
-  bool reasonable_coord(int i, int j) {
-    return i >= 0 && i < w && j >= 0 && j < h;
-  }
-  void remove_trios() {
-    std::vector<std::tuple<int, int, int>> remove_i;
-    std::vector<std::tuple<int, int, int>> remove_j;
-    for (int i = 0; i < w; ++i) {
-      for (int j = 0; j < h; ++j) {
-        int offset_j = 1;
-        int offset_i = 1;
-        while (j + offset_j < h && at(i, j) == at(i, j + offset_j)) {
-          offset_j += 1;
-        }
-        if (offset_j > 2) {
-          remove_i.push_back({i, j, offset_j});
-        }
-        while (i + offset_i < w && at(i, j) == at(i + offset_i, j)) {
-          offset_i += 1;
-        }
-        if (offset_i > 2) {
-          remove_j.push_back({i, j, offset_i});
-        }
-      }
-    }
-    for (auto t : remove_i) {
-      int i = std::get<0>(t);
-      int j = std::get<1>(t);
-      int offset = std::get<2>(t);
-      if (offset == 4) {
-        j = 0;
-        offset = h;
-        longers += 1;
-        normals = std::max(0, normals - 1);
-      }
-      for (int jj = j; jj < j + offset; ++jj) {
-        at(i, jj) = 0;
-        if (is_magic(i, jj)) {
-          score -= 3;
-          magic_tiles.erase({i, jj});
-        }
-        if (is_magic2(i, jj)) {
-          score += 3;
-          magic_tiles2.erase({i, jj});
-        }
-        score += 1;
-      }
-      if (offset == 5) {
-        for (int i = 0; i < w; ++i) {
-          at(uniform_dist_2(e1), uniform_dist_3(e1)) = 0;
-          score += 1;
-        }
-        longests += 1;
-        normals = std::max(0, normals - 1);
-      }
-      normals += 1;
-    }
-    for (auto t : remove_j) {
-      int i = std::get<0>(t);
-      int j = std::get<1>(t);
-      int offset = std::get<2>(t);
-      if (offset == 4) {
-        i = 0;
-        offset = w;
-        longers += 1;
-        normals = std::max(0, normals - 1);
-      }
-      for (int ii = i; ii < i + offset; ++ii) {
-        at(ii, j) = 0;
-        if (is_magic(ii, j)) {
-          score -= 3;
-          magic_tiles.erase({ii, j});
-        }
-        if (is_magic2(ii, j)) {
-          score += 3;
-          magic_tiles2.erase({ii, j});
-        }
-        score += 1;
-      }
-      if (offset == 5) {
-        for (int i = 0; i < w; ++i) {
-          at(uniform_dist_2(e1), uniform_dist_3(e1)) = 0;
-          score += 1;
-        }
-        longests += 1;
-        normals = std::max(0, normals - 1);
-      }
-      normals += 1;
-    }
-    for (int i = 0; i < int(remove_i.size()); ++i) {
-      for (int j = 0; j < int(remove_j.size()); ++j) {
-        auto t1 = remove_i[i];
-        auto t2 = remove_j[j];
-        auto i1 = std::get<0>(t1);
-        auto j1 = std::get<1>(t1);
-        auto o1 = std::get<2>(t1);
-        auto i2 = std::get<0>(t2);
-        auto j2 = std::get<1>(t2);
-        auto o2 = std::get<2>(t2);
-        if (i1 >= i2 && i1 < (i2 + o2) && j2 >= j1 && j2 < (j1 + o1)) {
-          for (int m = -1; m < 2; ++m) {
-            for (int n = -1; n < 2; ++n) {
-              if (reasonable_coord(i1 + m, j1 + n)) {
-                at(i1 + m, j1 + n) = 0;
-                score += 1;
-              }
-            }
-          }
-          crosses += 1;
-          normals = std::max(0, normals - 2);
-        }
-      }
-    }
-  }
-  void fill_up() {
-    int curr_i = -1;
-    for (int i = 0; i < w; ++i) {
-      for (int j = 0; j < h; ++j) {
-        if (at(i, j) == 0) {
-          curr_i = i;
-          while (curr_i < w - 1 && at(curr_i + 1, j) == 0) {
-            curr_i += 1;
-          }
-          for (int k = curr_i; k >= 0; --k) {
-            if (at(k, j) != 0) {
-              at(curr_i, j) = at(k, j);
-              if (is_magic(k, j)) {
-                magic_tiles.erase({k, j});
-                magic_tiles.insert({curr_i, j});
-              }
-              if (is_magic2(k, j)) {
-                magic_tiles2.erase({k, j});
-                magic_tiles2.insert({curr_i, j});
-              }
-              curr_i -= 1;
-            }
-          }
-          for (int k = curr_i; k >= 0; --k) {
-            at(k, j) = uniform_dist(e1);
-            if (coin(e1) == 1) {
-              magic_tiles.insert({k, j});
-            }
-            if (coin2(e1) == 1) {
-              magic_tiles2.insert({k, j});
-            }
-          }
-        }
-      }
+public:
+  FileWriter() : _thread{[this] { run(); }} {}
+  ~FileWriter() {
+    {
+      std::lock_guard lock(_mutex);
+      _stop = true;
     }
+    _cv.notify_all();
+    _thread.join();
   }
-  void stabilize() {
-    auto old_board = *this;
-    do {
-      old_board = *this;
-      remove_trios();
-      fill_up();
-    } while (!(*this == old_board));
-    match_patterns();
-    match_threes();
-  }
-  void step() {
-    remove_trios();
-    fill_up();
-    match_patterns();
-    match_threes();
-  }
-  void zero() {
-    score = 0;
-    normals = 0;
-    longers = 0;
-    longests = 0;
-    crosses = 0;
-  }
-  // New interface starts here
-  std::vector<std::tuple<int, int, int>> remove_one_thing() {
-    std::vector<std::tuple<int, int, int>> res;
-    if (!rm_i.empty()) {
-      auto t = rm_i.back();
-      int i = std::get<0>(t);
-      int j = std::get<1>(t);
-      int offset = std::get<2>(t);
-      if (offset == 4) {
-        j = 0;
-        offset = h;
-        longers += 1;
-        normals = std::max(0, normals - 1);
-      }
-      for (int jj = j; jj < j + offset; ++jj) {
-        res.emplace_back(i, jj, at(i, jj));
-        at(i, jj) = 0;
-        if (is_magic(i, jj)) {
-          score -= 3;
-          magic_tiles.erase({i, jj});
-        }
-        if (is_magic2(i, jj)) {
-          score += 3;
-          magic_tiles2.erase({i, jj});
-        }
-        score += 1;
-      }
-      if (offset == 5) {
-        std::set<std::pair<int, int>> r;
-        for (int i = 0; i < w; ++i) {
-          int x, y;
-          do {
-            x = uniform_dist_2(e1);
-            y = uniform_dist_3(e1);
-          } while (r.contains({x, y}));
-          r.insert({x, y});
-          res.emplace_back(x, y, at(x, y));
-          at(x, y) = 0;
-          score += 1;
-        }
-        longests += 1;
-        normals = std::max(0, normals - 1);
-      }
-      normals += 1;
-      rm_i.pop_back();
-      return res;
-    }
-    if (!rm_j.empty()) {
-      auto t = rm_j.back();
-      int i = std::get<0>(t);
-      int j = std::get<1>(t);
-      int offset = std::get<2>(t);
-      if (offset == 4) {
-        i = 0;
-        offset = w;
-        longers += 1;
-        normals = std::max(0, normals - 1);
-      }
-      for (int ii = i; ii < i + offset; ++ii) {
-        res.emplace_back(ii, j, at(ii, j));
-        at(ii, j) = 0;
-        if (is_magic(ii, j)) {
-          score -= 3;
-          magic_tiles.erase({ii, j});
-        }
-        if (is_magic2(ii, j)) {
-          score += 3;
-          magic_tiles2.erase({ii, j});
-        }
-        score += 1;
-      }
-      if (offset == 5) {
-        std::set<std::pair<int, int>> r;
-        for (int i = 0; i < w; ++i) {
-          int x, y;
-          do {
-            x = uniform_dist_2(e1);
-            y = uniform_dist_3(e1);
-          } while (r.contains({x, y}));
-          r.insert({x, y});
-          res.emplace_back(x, y, at(x, y));
-          at(x, y) = 0;
-          score += 1;
-        }
-        longests += 1;
-        normals = std::max(0, normals - 1);
-      }
-      normals += 1;
-      rm_j.pop_back();
-      return res;
-    }
-    if (!rm_b.empty()) {
-      auto t = rm_b.back();
-      int i = std::get<0>(t);
-      int j = std::get<1>(t);
-      for (int m = -2; m < 3; ++m) {
-        for (int n = -2; n < 3; ++n) {
-          if (reasonable_coord(i + m, j + n)) {
-            res.emplace_back(i + m, j + n, at(i + m, j + n));
-            at(i + m, j + n) = 0;
-            score += 1;
-          }
-        }
-      }
-      crosses += 1;
-      normals = std::max(0, normals - 2);
-      rm_b.pop_back();
-      return res;
+  void write(std::string path, std::function<std::string()> make_text) {
+    {
+      std::lock_guard lock(_mutex);
+      _pending[std::move(path)] = std::move(make_text);
     }
-    return res;
+    _cv.notify_all();
   }
-  void prepare_removals() {
-    rm_i.clear();
-    rm_j.clear();
-    rm_b.clear();
-    matched_patterns.clear();
-    matched_threes.clear();
-    for (int i = 0; i < w; ++i) {
-      for (int j = 0; j < h; ++j) {
-        int offset_j = 1;
-        int offset_i = 1;
-        while (j + offset_j < h && at(i, j) == at(i, j + offset_j)) {
-          offset_j += 1;
-        }
-        if (offset_j > 2) {
-          rm_i.emplace_back(i, j, offset_j);
-        }
-        while (i + offset_i < w && at(i, j) == at(i + offset_i, j)) {
-          offset_i += 1;
-        }
-        if (offset_i > 2) {
-          rm_j.emplace_back(i, j, offset_i);
-        }
-      }
-    }
-    for (int i = 0; i < int(rm_i.size()); ++i) {
-      for (int j = 0; j < int(rm_j.size()); ++j) {
-        auto t1 = rm_i[i];
-        auto t2 = rm_j[j];
-        auto i1 = std::get<0>(t1);
-        auto j1 = std::get<1>(t1);
-        auto o1 = std::get<2>(t1);
-        auto i2 = std::get<0>(t2);
-        auto j2 = std::get<1>(t2);
-        auto o2 = std::get<2>(t2);
-        if (i1 >= i2 && i1 < (i2 + o2) && j2 >= j1 && j2 < (j1 + o1)) {
-          rm_b.emplace_back(i1, j2);
-        }
-      }
-    }
-    auto sorter = [](auto &t1, auto &t2) {
-      auto i1 = std::get<0>(t1);
-      auto i2 = std::get<0>(t2);
-      return i1 > i2;
-    };
-    std::sort(std::begin(rm_i), std::end(rm_i), sorter);
-    std::sort(std::begin(rm_j), std::end(rm_j), sorter);
-    std::sort(std::begin(rm_b), std::end(rm_b), sorter);
+  void write(std::string path, std::string text) {
+    write(std::move(path), [text = std::move(text)] { return text; });
   }
-  bool has_removals() { return rm_i.size() + rm_j.size() + rm_b.size(); }
-  void match_threes() {
-    matched_threes.clear();
-    for (const SizedPattern &sp : threes) {
-      for (int i = 0; i <= w - sp.w; ++i) {
-        for (int j = 0; j <= h - sp.h; ++j) {
-          if (match_pattern(i, j, sp)) {
-            for (const Point &p : sp.pat) {
-              matched_threes.insert({i + p.x(), j + p.y()});
-            }
-          }
-        }
-      }
-    }
+  // Blocks until everything requested so far is on disk.
+  void wait() {
+    std::unique_lock lock(_mutex);
+    _cv.wait(lock, [this] { return _pending.empty() && !_busy; });
   }
-  bool is_three(int i, int j) { return matched_threes.contains({i, j}); }
 };
 
-bool operator==(const Board &a, const Board &b) {
-  if (a.w != b.w || a.h != b.h) {
-    return false;
-  }
-  for (int i = 0; i < a.w * a.h; ++i) {
-    if (a.board[i] != b.board[i]) {
-      return false;
-    }
-  }
-  return true;
-}
-
-std::ostream &operator<<(std::ostream &of, const Board &b) {
-  of << b.score << "\n"
-     << b.normals << "\n"
-     << b.longers << "\n"
-     << b.longests << "\n"
-     << b.crosses << "\n"
-     << b.w << " " << b.h << "\n";
-  for (int i = 0; i < b.w; ++i) {
-    for (int j = 0; j < b.h; ++j) {
-      of << b.at(i, j) << " ";
-    }
-    of << std::endl;
-  }
-  of << b.magic_tiles.size() << "\n";
-  for (auto it = b.magic_tiles.begin(); it != b.magic_tiles.end(); ++it) {
-    of << it->first << " " << it->second << " ";
-  }
-  of << "\n";
-  of << b.magic_tiles2.size() << "\n";
-  for (auto it = b.magic_tiles2.begin(); it != b.magic_tiles2.end(); ++it) {
-    of << it->first << " " << it->second << " ";
-  }
-  of << "\n";
-  return of;
+std::string ReadFile(const char *path) {
+  std::ifstream input(path, std::ios::binary);
+  std::ostringstream text;
+  text << input.rdbuf();
+  return text.str();
 }
 
-std::istream &operator>>(std::istream &in, Board &b) {
-  in >> b.score >> b.normals >> b.longers >> b.longests >> b.crosses >> b.w >>
-      b.h;
-  b.board.resize(b.w * b.h);
-  for (int i = 0; i < b.w; ++i) {
-    for (int j = 0; j < b.h; ++j) {
-      in >> b.at(i, j);
-    }
+// Distribution of the times of drawn frames, in milliseconds.
+void PrintFrameTimes(std::vector<double> times) {
+  if (times.empty()) {
+    return;
   }
-  int s;
-  in >> s;
-  b.magic_tiles.clear();
-  int i, j;
-  for (int k = 0; k < s; ++k) {
-    in >> i >> j;
-    b.magic_tiles.insert({i, j});
+  std::sort(times.begin(), times.end());
+  double total = 0;
+  for (double t : times) {
+    total += t;
   }
-  in >> s;
-  for (int k = 0; k < s; ++k) {
-    in >> i >> j;
-    b.magic_tiles2.insert({i, j});
-  }
-  return in;
+  auto pct = [&](double p) {
+    return 1000 * times[size_t(p * (times.size() - 1))];
+  };
+  std::cout << fmt::format("{} frames in {:.2f} s: mean {:.3f} ms, p50 {:.3f}, "
+                           "p90 {:.3f}, p99 {:.3f}, max {:.3f}\n",
+                           times.size(), total, 1000 * total / times.size(),
+                           pct(0.5), pct(0.9), pct(0.99), 1000 * times.back());
 }
 
 using Leaderboard = std::vector<std::pair<std::string, int>>;
@@ -683,31 +146,32 @@ Leaderboard ReadLeaderboard() {
   return res;
 }
 
-void WriteLeaderboard(Leaderboard leaderboard) {
+void WriteLeaderboard(FileWriter &writer, Leaderboard leaderboard) {
   std::string text;
   std::sort(std::begin(leaderboard), std::end(leaderboard),
             [](auto &a, auto &b) { return a.second > b.second; });
   for (auto it : leaderboard) {
     text += fmt::format("{};{}\n", it.first, it.second);
   }
-  std::ofstream output("leaderboard.txt");
-  output << text;
+  writer.write("leaderboard.txt", std::move(text));
 }
 
-void DrawLeaderboard(Leaderboard leaderboard, size_t offset, int place) {
+// The leaderboard is kept sorted by score.
+void DrawLeaderboard(const Leaderboard &leaderboard, size_t offset,
+                     int place) {
   auto w = GetRenderWidth();
   auto h = GetRenderHeight();
   auto start_y = h / 4 + 10;
   DrawRectangle(w / 4, h / 4, w / 2, h / 2, WHITE);
   DrawText("Leaderboard:", w / 4 + 10, start_y, 20, BLACK);
-  std::sort(std::begin(leaderboard), std::end(leaderboard),
-            [](auto &a, auto &b) { return a.second > b.second; });
   offset = std::min(offset, leaderboard.size() - 1);
   auto finish = std::min(offset + 9, leaderboard.size());
   for (auto it = leaderboard.begin() + offset;
        it != leaderboard.begin() + finish; ++it) {
-    std::string text = fmt::format(
-        "{}. {}: {}\n", (it - leaderboard.begin()) + 1, it->first, it->second);
+    char text[64];
+    *fmt::format_to_n(text, sizeof(text) - 1, "{}. {}: {}",
+                      (it - leaderboard.begin()) + 1, it->first, it->second)
+         .out = 0;
     start_y += 30;
     Color c = BLACK;
     switch (it - leaderboard.begin()) {
@@ -724,10 +188,10 @@ void DrawLeaderboard(Leaderboard leaderboard, size_t offset, int place) {
       break;
     }
     if (place == it - leaderboard.begin()) {
-      auto width = MeasureText(text.c_str(), 20);
+      auto width = MeasureText(text, 20);
       DrawRectangle(w / 4 + 5, start_y, width + 10, 25, LIGHTGRAY);
     }
-    DrawText(text.c_str(), w / 4 + 10, start_y, 20, c);
+    DrawText(text, w / 4 + 10, start_y, 20, c);
   }
   if (finish != leaderboard.size()) {
     DrawText("...", w / 4 + 10, start_y + 30, 20, BLACK);
@@ -746,6 +210,155 @@ bool in_button(Vector2 pos, Button button) {
          pos.y < button.y2;
 }
 
+struct QualityTier {
+  std::string_view name;
+  // Most flying particles alive at once.
+  size_t particles;
+  bool shake;
+  // Gradient overlays on magic and bonus tiles, flat squares otherwise.
+  bool gradients;
+  // Tiles as shapes, flat squares otherwise.
+  bool shapes;
+  // Sides of circles drawn as polygons, 0 for raylib's full circles.
+  int circle_sides;
+};
+
+constexpr QualityTier quality_tiers[] = {
+    {"LOW", 0, false, false, false, 8},
+    {"MEDIUM", 64, false, false, true, 12},
+    {"HIGH", 256, true, true, true, 0},
+    {"ULTRA", SIZE_MAX, true, true, true, 0},
+};
+constexpr int quality_tier_count = std::size(quality_tiers);
+
+// Picks the quality tier from measured frame times: a tier down as soon as
+// frames come late, a tier up after a long stretch with time to spare. Only
+// frames that animate are measured, since idle ones wait for input.
+class QualityController {
+  static constexpr float target = 1.0f / 60;
+  int _tier = quality_tier_count - 1;
+  int _pinned = -1;
+  // Moving averages of the whole frame and of the part spent before
+  // presenting it.
+  float _frame = target;
+  float _busy = 0;
+  int _hold = 0;
+  int _calm = 0;
+
+public:
+  const QualityTier &tier() const { return quality_tiers[_tier]; }
+  int index() const { return _tier; }
+  bool pinned() const { return _pinned >= 0; }
+  // Cycles automatic, then every tier pinned, then automatic again.
+  void pin(int tier) {
+    _pinned = tier;
+    _tier = tier;
+  }
+  void cycle_pin() {
+    _pinned = _pinned + 1 == quality_tier_count ? -1 : _pinned + 1;
+    if (pinned()) {
+      _tier = _pinned;
+    }
+    _hold = 60;
+    _calm = 0;
+  }
+  // Returns whether the tier changed.
+  bool measure(float frame, float busy) {
+    _frame += (std::min(frame, 0.25f) - _frame) / 16;
+    _busy += (busy - _busy) / 16;
+    if (pinned() || --_hold > 0) {
+      return false;
+    }
+    if ((_frame > target * 1.15f || _busy > target * 0.9f) && _tier > 0) {
+      _tier -= 1;
+      _hold = 30;
+      _calm = 0;
+      return true;
+    }
+    _calm = _busy < target * 0.45f && _frame < target * 1.05f ? _calm + 1 : 0;
+    if (_calm > 180 && _tier + 1 < quality_tier_count) {
+      _tier += 1;
+      _hold = 120;
+      _calm = 0;
+      return true;
+    }
+    return false;
+  }
+};
+
+struct CachedText {
+  std::string text;
+  int width = 0;
+};
+
+// Laid-out HUD strings. Each one is rebuilt and re-measured only when the
+// values shown in it change, so steady frames don't format or allocate.
+class TextCache {
+  std::array<int, 6> _stats_values{};
+  CachedText _stats;
+  std::string _name;
+  CachedText _player;
+  int _volume = -1;
+  CachedText _sound;
+  int _quality = -1;
+  CachedText _quality_text;
+  std::vector<std::pair<std::string_view, CachedText>> _labels;
+
+public:
+  TextCache() { _stats_values.fill(-1); }
+  const CachedText &stats(int moves, int score, int trios, int quartets,
+                          int quintets, int crosses) {
+    std::array<int, 6> values{moves, score, trios, quartets, quintets, crosses};
+    if (values != _stats_values) {
+      _stats_values = values;
+      _stats.text = fmt::format("Moves: {}\nScore: {}\nTrios: {}\nQuartets: "
+                                "{}\nQuintets: {}\nCrosses: {}",
+                                moves, score, trios, quartets, quintets,
+                                crosses);
+      _stats.width = MeasureText(_stats.text.c_str(), 30);
+    }
+    return _stats;
+  }
+  const CachedText &player(const std::string &name) {
+    if (_player.text.empty() || name != _name) {
+      _name = name;
+      _player.text = "Player:\n" + name;
+      _player.width = MeasureText(_player.text.c_str(), 20);
+    }
+    return _player;
+  }
+  const CachedText &sound(float volume) {
+    int percent = int(volume * 100);
+    if (percent != _volume) {
+      _volume = percent;
+      _sound.text = fmt::format("SOUND ({}%)", percent);
+      _sound.width = MeasureText(_sound.text.c_str(), 20);
+    }
+    return _sound;
+  }
+  const CachedText &quality(const QualityController &q) {
+    int key = q.index() * 2 + q.pinned();
+    if (key != _quality) {
+      _quality = key;
+      _quality_text.text = fmt::format("Quality: {}{}", q.tier().name,
+                                       q.pinned() ? " (pinned)" : "");
+      _quality_text.width = MeasureText(_quality_text.text.c_str(), 20);
+    }
+    return _quality_text;
+  }
+  // Labels are expected to be string literals, which are never rebuilt.
+  const CachedText &label(std::string_view text) {
+    for (auto &[key, value] : _labels) {
+      if (key == text) {
+        return value;
+      }
+    }
+    CachedText value{std::string(text), 0};
+    value.width = MeasureText(value.text.c_str(), 20);
+    return _labels.emplace_back(text, std::move(value)).second;
+  }
+};
+
 bool operator==(const Color &a, const Color &b) {
   return a.r == b.r && a.g == b.g && a.b == a.b && a.a == b.a;
 }
@@ -753,24 +366,31 @@ class ButtonMaker {
   bool _play_sound;
   Sound _sound;
   float _volume;
-  std::vector<Button> buttons;
+  TextCache &_texts;
+  const Input &_input;
+  // Every button of a frame, without allocating.
+  std::array<Button, 16> buttons;
+  size_t button_count = 0;
   static bool enter;
 
 public:
-  ButtonMaker(bool play_sound, Sound sound, float volume)
-      : _play_sound{play_sound}, _sound{sound}, _volume{volume} {}
-  Button draw_button(Vector2 place, std::string text, bool enabled) {
-    bool button_down = IsMouseButtonDown(MOUSE_BUTTON_LEFT);
-    auto pos = GetMousePosition();
+  ButtonMaker(bool play_sound, Sound sound, float volume, TextCache &texts,
+              const Input &input)
+      : _play_sound{play_sound}, _sound{sound}, _volume{volume},
+        _texts{texts}, _input{input} {}
+  Button draw_button(Vector2 place, std::string_view text, bool enabled) {
+    bool slider = text == "SOUND";
+    bool button_down = _input.button_down(MOUSE_BUTTON_LEFT);
+    auto pos = _input.mouse();
     if (in_button(pos, Button{int(place.x), int(place.y), int(place.x + 200),
                               int(place.y + 30)})) {
       Color c = enabled ? YELLOW : (button_down ? DARKGRAY : LIGHTGRAY);
-      if (text == "SOUND") {
+      if (slider) {
         int level = int(_volume * 200);
         DrawRectangle(place.x, place.y, level, 30, YELLOW);
         DrawRectangle(place.x + level, place.y, 200 - level, 30, LIGHTGRAY);
         if (button_down) {
-          int x = GetMouseX();
+          int x = _input.mouse().x;
           _volume = (x - place.x) / 200.0;
         }
       } else {
@@ -778,7 +398,7 @@ public:
       }
     } else {
       Color c = enabled ? GOLD : GRAY;
-      if (text == "SOUND") {
+      if (slider) {
         int level = int(_volume * 200);
         DrawRectangle(place.x, place.y, level, 30, GOLD);
         DrawRectangle(place.x + level, place.y, 200 - level, 30, GRAY);
@@ -786,14 +406,14 @@ public:
         DrawRectangle(place.x, place.y, 200, 30, c);
       }
     }
-    const char *label =
-        text == "SOUND" ? fmt::format("SOUND ({}%)", int(_volume * 100)).c_str()
-                        : text.c_str();
-    auto width = MeasureText(label, 20);
-    DrawText(label, place.x + 100 - width / 2, place.y + 5, 20, BLACK);
+    const CachedText &label = slider ? _texts.sound(_volume) : _texts.label(text);
+    DrawText(label.text.c_str(), place.x + 100 - label.width / 2, place.y + 5,
+             20, BLACK);
     auto button = Button{int(place.x), int(place.y), int(place.x + 200),
                          int(place.y + 30)};
-    buttons.push_back(button);
+    if (button_count < buttons.size()) {
+      buttons[button_count++] = button;
+    }
     return button;
   }
   void play_sound() {
@@ -801,8 +421,9 @@ public:
       return;
     }
     bool in = false;
-    for (auto it = buttons.begin(); it != buttons.end(); ++it) {
-      auto pos = GetMousePosition();
+    for (auto it = buttons.begin(); it != buttons.begin() + button_count;
+         ++it) {
+      auto pos = _input.mouse();
       if (in_button(pos, *it)) {
         in = true;
         if (enter) {
@@ -822,86 +443,6 @@ public:
 
 bool ButtonMaker::enter = true;
 
-class Game {
-  std::string _name;
-  Board _board;
-  Board _old_board;
-  bool _work_board = false;
-  bool _first_work = true;
-  std::vector<std::tuple<int, int, int>> _removed_cells;
-
-public:
-  Game(size_t size) : _board{size, size}, _old_board{_board} {}
-  int counter = 0;
-  void new_game() {
-    counter = 0;
-    _work_board = false;
-    _board.fill();
-    _board.stabilize();
-    _board.zero();
-  }
-  void save() {
-    std::ofstream save("save.txt");
-    save << _name << " " << counter << "\n";
-    save << _board;
-  }
-  bool load() {
-    std::ifstream load("save.txt");
-    if (load) {
-      _work_board = false;
-      load >> _name >> counter >> _board;
-      _board.match_patterns();
-      _board.match_threes();
-      return true;
-    }
-    return false;
-  }
-  void save_state() { _old_board = _board; }
-  bool check_state() const { return _old_board == _board; }
-  void restore_state() { _board = _old_board; }
-  void match() {
-    _board.match_patterns();
-    _board.match_threes();
-  }
-  Board &board() { return _board; }
-  std::string &name() { return _name; }
-  void attempt_move(int row1, int col1, int row2, int col2) {
-    _first_work = true;
-    _work_board = true;
-    save_state();
-    _board.swap(row1, col1, row2, col2);
-    _board.prepare_removals();
-  }
-  std::vector<std::tuple<int, int, int>> step() {
-    std::vector<std::tuple<int, int, int>> res;
-    if (!_board.has_removals()) {
-      _board.prepare_removals();
-    }
-    if (!_board.has_removals()) {
-      if (_first_work) {
-        restore_state();
-      } else {
-        counter += 1;
-      }
-      _work_board = false;
-      _board.match_patterns();
-      _board.match_threes();
-    }
-    res = _board.remove_one_thing();
-    _board.fill_up();
-    _first_work = false;
-    return res;
-  }
-  bool is_finished() { return counter == 50; }
-  bool is_processing() { return _work_board; }
-  std::string game_stats() {
-    return fmt::format("Moves: {}\nScore: {}\nTrios: {}\nQuartets: "
-                       "{}\nQuintets: {}\nCrosses: {}",
-                       counter, _board.score, _board.normals, _board.longers,
-                       _board.longests, _board.crosses);
-  }
-};
-
 struct Particle {
   float dx = 0;
   float dy = 0;
@@ -926,11 +467,194 @@ void button_flag(Vector2 pos, Button button, bool &flag) {
   }
 }
 
+void DrawCircleDetail(Vector2 center, float radius, int sides, Color color) {
+  if (sides == 0) {
+    DrawCircleV(center, radius, color);
+  } else {
+    DrawPoly(center, sides, radius, 0, color);
+  }
+}
+
+Color tile_color(int tile, bool nonacid_colors) {
+  switch (tile) {
+  case 1:
+    return nonacid_colors ? PINK : RED;
+  case 2:
+    return nonacid_colors ? LIME : GREEN;
+  case 3:
+    return nonacid_colors ? SKYBLUE : BLUE;
+  case 4:
+    return nonacid_colors ? GOLD : ORANGE;
+  case 5:
+    return nonacid_colors ? PURPLE : MAGENTA;
+  case 6:
+    return nonacid_colors ? BEIGE : YELLOW;
+  default:
+    return BLACK;
+  }
+}
+
+// Allocations of the last call and the worst call of every tag, frames
+// first. Formats into a stack buffer, so that the overlay itself doesn't
+// allocate.
+void DrawAllocOverlay(int x, int y, uint64_t budget) {
+  if (!alloc_tracking) {
+    DrawText("Allocation tracking is off", x, y, 20, DARKGRAY);
+    return;
+  }
+  std::array<AllocTag, 16> tags;
+  size_t count = std::min(alloc_tags(tags.data(), tags.size()), tags.size());
+  std::stable_partition(tags.begin(), tags.begin() + count, [](auto &t) {
+    return std::string_view(t.name) == "frame";
+  });
+  char text[128];
+  for (size_t k = 0; k < count; ++k) {
+    const AllocTag &t = tags[k];
+    *fmt::format_to_n(text, sizeof(text) - 1,
+                      "{}: {} allocs, {} B (worst {}, {} B) in {} calls",
+                      t.name, t.last.count, t.last.bytes, t.peak.count,
+                      t.peak.bytes, t.calls)
+         .out = 0;
+    bool over = budget != 0 && std::string_view(t.name) == "frame" &&
+                t.last.count > budget;
+    DrawText(text, x, y + int(k) * 22, 20, over ? RED : DARKGRAY);
+  }
+}
+
+// The part of the board shown in the square board area. At zoom 1 the whole
+// board fits; the wheel zooms around the cursor, dragging with the right
+// button pans and Z goes back to the whole board.
+struct BoardView {
+  // Board size the view was made for.
+  int n = 0;
+  float zoom = 1;
+  // Board point, in cells, at the centre of the board area.
+  float cx = 0;
+  float cy = 0;
+
+  static BoardView whole(int n) { return {n, 1, n / 2.0f, n / 2.0f}; }
+  int cell_size(int area, int n) const {
+    return std::max(1, int(float(area) / n * zoom));
+  }
+  // (mx, my) is the cursor relative to the centre of the area.
+  void zoom_at(float steps, float mx, float my, int area, int n) {
+    int before = cell_size(area, n);
+    // At least three cells stay in view.
+    zoom = std::clamp(zoom * std::pow(1.25f, steps), 1.0f,
+                      std::max(1.0f, n / 3.0f));
+    int after = cell_size(area, n);
+    cx += mx / before - mx / after;
+    cy += my / before - my / after;
+  }
+  void pan(Vector2 delta, int ss) {
+    cx -= delta.x / ss;
+    cy -= delta.y / ss;
+  }
+  // Keeps the area covered by the board, or the board centred if it fits.
+  void clamp(int area, int n, int ss) {
+    if (n * ss <= area) {
+      cx = cy = n / 2.0f;
+      return;
+    }
+    float half = area / 2.0f / ss;
+    cx = std::clamp(cx, half, n - half);
+    cy = std::clamp(cy, half, n - half);
+  }
+};
+
+// Cells smaller than this many pixels are drawn as flat colour, all at once.
+constexpr int lod_cell_size = 6;
+
+// Boards up to this many cells are autosaved whenever the game goes idle.
+constexpr int autosave_idle_cells = 256 * 256;
+
+// Keys the main loop reacts to outside of name input.
+constexpr KeyboardKey handled_keys[] = {
+    KEY_R, KEY_L, KEY_P,  KEY_M,  KEY_H,    KEY_A,     KEY_S,        KEY_O,
+    KEY_Q, KEY_Z, KEY_F3, KEY_UP, KEY_DOWN, KEY_ENTER, KEY_BACKSPACE};
+
 int main() {
   auto w = 1280;
   auto h = 800;
-  auto board_size = 16;
-  Game game(board_size);
+  // TIAR2_SIZE sets the size of new boards; a loaded save keeps its own.
+  int new_size = 16;
+  if (const char *size = std::getenv("TIAR2_SIZE")) {
+    new_size = std::clamp(std::atoi(size), 3, 4096);
+  }
+  // TIAR2_RULES=path plays the rule set of that file, see rule_set.h.
+  RuleSet rule_set;
+  std::string rules_error;
+  // TIAR2_RECORD=path records the input of the session. TIAR2_REPLAY=path
+  // plays a recording back as fast as it can, from the files the recording
+  // started with in a scratch directory, and prints frame times at the end.
+  Input input;
+  Session session;
+  std::filesystem::path start_dir = std::filesystem::current_path();
+  std::filesystem::path replay_dir;
+  if (const char *path = std::getenv("TIAR2_REPLAY")) {
+    if (!input.replay(path, session)) {
+      std::cerr << "Can't replay " << path << "\n";
+      return 1;
+    }
+    if (!session.rules.empty()) {
+      std::istringstream rules(session.rules);
+      auto set = parse_rule_set(rules, rules_error);
+      if (!set) {
+        std::cerr << "Can't replay " << path << ", rules " << rules_error
+                  << "\n";
+        return 1;
+      }
+      rule_set = std::move(*set);
+    }
+    replay_dir = std::filesystem::temp_directory_path() /
+                 fmt::format("tiar2-replay-{}", std::random_device{}());
+    std::filesystem::create_directories(replay_dir);
+    std::filesystem::current_path(replay_dir);
+    if (!session.save.empty()) {
+      std::ofstream("save.txt", std::ios::binary) << session.save;
+    }
+    std::ofstream("leaderboard.txt", std::ios::binary) << session.leaderboard;
+    w = session.width;
+    h = session.height;
+    new_size = session.board_size;
+  } else {
+    std::random_device rd;
+    session.game_seed = rd();
+    session.particle_seed = rd();
+    session.width = w;
+    session.height = h;
+    session.board_size = new_size;
+    // An autosave newer than save.txt means the last session ended without
+    // saving; it is resumed from where the autosave left it.
+    std::error_code ec;
+    auto autosaved = std::filesystem::last_write_time("autosave.txt", ec);
+    if (!ec) {
+      auto saved = std::filesystem::last_write_time("save.txt", ec);
+      if (ec || autosaved > saved) {
+        std::filesystem::rename("autosave.txt", "save.txt", ec);
+      }
+    }
+    if (const char *path = std::getenv("TIAR2_RULES")) {
+      auto set = load_rule_set(path, rules_error);
+      if (!set) {
+        std::cerr << "Can't use the rules in " << path << ", " << rules_error
+                  << "\n";
+        return 1;
+      }
+      rule_set = std::move(*set);
+      session.rules = format_rule_set(rule_set);
+    }
+    if (const char *path = std::getenv("TIAR2_RECORD")) {
+      session.save = ReadFile("save.txt");
+      session.leaderboard = ReadFile("leaderboard.txt");
+      if (!input.record(path, session)) {
+        std::cerr << "Can't record to " << path << "\n";
+        return 1;
+      }
+    }
+  }
+  BasicGame<Board> game(new_size, rule_set.rules);
+  game.seed(session.game_seed);
   bool first_click = true;
   int saved_row = 0;
   int saved_col = 0;
@@ -946,32 +670,110 @@ int main() {
   float volume = 0.0f;
   int leaderboard_place = -1;
   Leaderboard leaderboard = ReadLeaderboard();
+  FileWriter writer;
+  TextCache texts;
+  double autosave_time = 0;
+  uint64_t autosave_hash = 0;
+  bool redraw = true;
+  int last_hover = -1;
+  HintWorker hint_worker(rule_set);
+  LiveExport live(std::getenv("TIAR2_LIVE"));
+  const Hints *drawn_hints = nullptr;
+  SwapSpeculator<Board> speculator;
+  const Speculation *drawn_speculation = nullptr;
+  // Plays the swap of the selected cell with (row, col), with its removals
+  // from the speculator when they are ready.
+  auto play_move = [&](int row, int col) {
+    AllocScope scope("attempt move");
+    if (auto removals = speculator.take(game.board(), saved_row, saved_col,
+                                        row, col)) {
+      if (game.attempt_move(row, col, saved_row, saved_col,
+                            std::move(*removals))) {
+        input.event({GameEvent::move, {row, col, saved_row, saved_col}});
+      }
+    } else if (game.attempt_move(row, col, saved_row, saved_col)) {
+      input.event({GameEvent::move, {row, col, saved_row, saved_col}});
+    }
+  };
+  // New games and loads go through these, so that a recording has them.
+  auto new_game = [&] {
+    game.new_game();
+    input.event({GameEvent::new_game});
+  };
+  // Queues the game as it is now; the writer thread formats it.
+  auto save_game = [&](const char *path) {
+    writer.write(path, [name = game.name(), moves = game.counter,
+                        board = game.board()] {
+      return BasicGame<Board>::save(name, moves, board);
+    });
+  };
+  // A save that doesn't read keeps the game that is running.
+  auto load_game = [&] {
+    if (!std::filesystem::exists("save.txt")) {
+      return false;
+    }
+    std::string save = ReadFile("save.txt");
+    std::istringstream in(save);
+    if (!game.load(in)) {
+      std::cerr << "Can't load save.txt\n";
+      return false;
+    }
+    input.event({GameEvent::load, {}, std::move(save)});
+    return true;
+  };
+  BoardView view;
+  Texture2D lod_texture{};
+  std::vector<Color> lod_pixels;
+  QualityController quality;
+  // Start and busy time of the last drawn frame, and whether it animated.
+  double frame_start = 0;
+  float frame_busy = 0;
+  bool frame_animated = false;
+  // F3 shows allocation counts; frames over TIAR2_ALLOC_BUDGET allocations
+  // are shown in red.
+  bool alloc_overlay = false;
+  uint64_t alloc_budget = 0;
+  if (const char *budget = std::getenv("TIAR2_ALLOC_BUDGET")) {
+    alloc_budget = std::strtoull(budget, nullptr, 10);
+  }
   std::vector<Particle> flying;
   std::vector<Explosion> staying;
-  std::default_random_engine eng{static_cast<unsigned>(
-      std::chrono::system_clock::now().time_since_epoch().count())};
+  std::default_random_engine eng{session.particle_seed};
+  // Of the drawn frames of a replay.
+  std::vector<double> frame_times;
+  double frame_begin = 0;
   std::uniform_int_distribution<int> dd{-10, 10};
   InitAudioDevice();
-  Sound psound = LoadSound("p.ogg");
-  Sound ksound = LoadSound("k.ogg");
-  if (!game.load()) {
-    game.new_game();
+  Sound psound = LoadSoundFromWave(p_wave);
+  Sound ksound = LoadSoundFromWave(k_wave);
+  if (!load_game()) {
+    new_game();
     input_name = true;
   }
   SetConfigFlags(FLAG_WINDOW_RESIZABLE);
   InitWindow(w, h, "Tiar2");
-  auto icon = LoadImage("icon.png");
-  SetWindowIcon(icon);
-  SetTargetFPS(60);
-  while (!WindowShouldClose()) {
+  SetWindowIcon(icon_image);
+  SetTargetFPS(input.is_replaying() ? 0 : 60);
+  if (input.is_replaying()) {
+    // Timings are only comparable with everything drawn.
+    quality.pin(quality_tier_count - 1);
+  }
+  while (!WindowShouldClose() && input.next_frame()) {
+    AllocScope frame_scope("frame");
+    if (input.is_replaying()) {
+      frame_begin = GetTime();
+      if (input.width() != w || input.height() != h) {
+        SetWindowSize(input.width(), input.height());
+      }
+    }
     SetMasterVolume(volume);
     if (frame_counter == 60) {
       frame_counter = 0;
     } else {
       frame_counter += 1;
     }
-    w = GetRenderWidth();
-    h = GetRenderHeight();
+    w = input.width();
+    h = input.height();
     auto s = 0;
     if (w > h) {
       s = h;
@@ -979,23 +781,126 @@ int main() {
       s = w;
     }
     auto margin = 10;
-    auto board_x = w / 2 - s / 2 + margin;
-    auto board_y = h / 2 - s / 2 + margin;
-    auto ss = (s - 2 * margin) / board_size;
+    auto area = s - 2 * margin;
+    auto area_x = w / 2 - s / 2 + margin;
+    auto area_y = h / 2 - s / 2 + margin;
+    int board_size = game.board().width();
+    if (view.n != board_size || (!input_name && input.key_pressed(KEY_Z))) {
+      view = BoardView::whole(board_size);
+    }
+    auto mouse = input.mouse();
+    auto in_area = [&](Vector2 pos) {
+      return pos.x >= area_x && pos.y >= area_y && pos.x < area_x + area &&
+             pos.y < area_y + area;
+    };
+    if (!draw_leaderboard && !input_name && in_area(mouse) &&
+        input.wheel() != 0) {
+      view.zoom_at(input.wheel(), mouse.x - area_x - area / 2.0f,
+                   mouse.y - area_y - area / 2.0f, area, board_size);
+    }
+    auto ss = view.cell_size(area, board_size);
+    if (input.button_down(MOUSE_BUTTON_RIGHT)) {
+      view.pan(input.mouse_delta(), ss);
+    }
+    view.clamp(area, board_size, ss);
+    auto board_x = area_x + area / 2 - int(view.cx * ss);
+    auto board_y = area_y + area / 2 - int(view.cy * ss);
+    // Columns i0..i1 and rows j0..j1 of the board are at least partly in
+    // the area; nothing else is drawn.
+    int i0 = std::max(0, (area_x - board_x) / ss);
+    int i1 = std::min(board_size, (area_x + area - board_x + ss - 1) / ss);
+    int j0 = std::max(0, (area_y - board_y) / ss);
+    int j1 = std::min(board_size, (area_y + area - board_y + ss - 1) / ss);
     auto so = 2;
     auto mo = 0.5;
+    // While nothing animates the loop sleeps in PollInputEvents() until the
+    // next input event, and events that can't change the picture (mouse
+    // moves within the same cell or button) don't redraw it.
+    auto idle = [&] {
+      return !game.is_processing() && flying.empty() && staying.empty() &&
+             !input_name && !hint_worker.pending() && !speculator.pending();
+    };
+    bool input_seen = input.window_resized() || input.wheel() != 0 ||
+                      input.button_pressed(MOUSE_BUTTON_LEFT) ||
+                      input.button_released(MOUSE_BUTTON_LEFT) ||
+                      input.button_down(MOUSE_BUTTON_LEFT) ||
+                      input.button_down(MOUSE_BUTTON_RIGHT);
+    for (auto key : handled_keys) {
+      input_seen = input_seen || input.key_pressed(key);
+    }
+    int hover = -1;
+    if (in_area(mouse) && mouse.x >= board_x && mouse.y >= board_y &&
+        mouse.x < board_x + ss * board_size &&
+        mouse.y < board_y + ss * board_size) {
+      hover = int(mouse.y - board_y) / ss * board_size +
+              int(mouse.x - board_x) / ss;
+    } else if (mouse.x > w - 210 && mouse.x < w - 10 && mouse.y < h) {
+      hover = board_size * board_size + int(h - mouse.y) / 40;
+    }
+    // Hints are looked for only while shown and the board is at rest; the
+    // loop keeps polling until they arrive.
+    if (hints && !game.is_processing()) {
+      AllocScope scope("hint request");
+      hint_worker.request(game.board());
+    } else if (hint_worker.pending()) {
+      hint_worker.cancel();
+    }
+    auto hint = hints ? hint_worker.latest() : nullptr;
+    if (hint && hint->hash != game.board().hash()) {
+      hint = nullptr;
+    }
+    // While a cell is selected, the swap with the hovered neighbour is
+    // worked out ahead of the click.
+    int target_row = hover / std::max(board_size, 1);
+    int target_col = hover % std::max(board_size, 1);
+    if (!first_click && !game.is_processing() && hover >= 0 &&
+        hover < board_size * board_size &&
+        abs(target_row - saved_row) + abs(target_col - saved_col) == 1 &&
+        game.board().is_legal_swap(saved_row, saved_col, target_row,
+                                   target_col)) {
+      AllocScope scope("speculation request");
+      speculator.request(game.board(), saved_row, saved_col, target_row,
+                         target_col);
+    } else {
+      speculator.cancel();
+    }
+    auto speculation = speculator.latest();
+    if (speculation &&
+        !speculation->is_for(game.board().hash(), saved_row, saved_col,
+                             target_row, target_col)) {
+      speculation = nullptr;
+    }
+    redraw = redraw || hint.get() != drawn_hints ||
+             speculation.get() != drawn_speculation;
+    if (idle() && !input_seen && !redraw && hover == last_hover) {
+      frame_animated = false;
+      PollInputEvents();
+      continue;
+    }
+    if (frame_animated && quality.measure(GetFrameTime(), frame_busy) &&
+        flying.size() > quality.tier().particles) {
+      flying.erase(flying.begin() + quality.tier().particles, flying.end());
+    }
+    frame_start = GetTime();
+    redraw = input_seen;
+    last_hover = hover;
+    drawn_hints = hint.get();
+    drawn_speculation = speculation.get();
     if (game.is_processing() && frame_counter % 6 == 0) {
-      auto f = game.step();
+      std::vector<std::tuple<int, int, int>> f;
+      {
+        AllocScope scope("game step");
+        f = game.step();
+      }
+      live.removed(f);
       if (play_sound && !f.empty() && IsSoundReady(psound)) {
         PlaySound(psound);
       }
       if (particles) {
-        if (play_sound && !f.empty()) {
+        if (play_sound && !f.empty() && quality.tier().shake) {
           board_x += dd(eng);
           board_y += dd(eng);
         }
-        flying.reserve(flying.size() + f.size());
-        staying.reserve(staying.size() + f.size());
         for (auto it = f.begin(); it != f.end(); ++it) {
           Color c;
           int s;
@@ -1031,37 +936,74 @@ int main() {
             break;
           }
           }
-          flying.emplace_back(dd(eng), dd(eng), dd(eng),
-                              std::get<1>(*it) * ss + board_x + ss / 2,
-                              std::get<0>(*it) * ss + board_y + ss / 2, 0, c, 0,
-                              s);
+          if (flying.size() < quality.tier().particles) {
+            flying.emplace_back(dd(eng), dd(eng), dd(eng),
+                                std::get<1>(*it) * ss + board_x + ss / 2,
+                                std::get<0>(*it) * ss + board_y + ss / 2, 0, c,
+                                0, s);
+          }
           staying.emplace_back(std::get<1>(*it), std::get<0>(*it), 0);
         }
       }
     }
     BeginDrawing();
     ClearBackground(RAYWHITE);
+    BeginScissorMode(area_x, area_y, area, area);
     DrawRectangle(board_x, board_y, ss * board_size, ss * board_size, BLACK);
-    for (int i = 0; i < board_size; ++i) {
-      for (int j = 0; j < board_size; ++j) {
+    if (ss < lod_cell_size) {
+      // One texel per visible cell, scaled up in a single draw.
+      int cw = i1 - i0;
+      int ch = j1 - j0;
+      lod_pixels.resize(cw * ch);
+      for (int j = j0; j < j1; ++j) {
+        for (int i = i0; i < i1; ++i) {
+          lod_pixels[(j - j0) * cw + i - i0] =
+              tile_color(game.board().at(j, i), nonacid_colors);
+        }
+      }
+      if (lod_texture.width < cw || lod_texture.height < ch) {
+        if (IsTextureReady(lod_texture)) {
+          UnloadTexture(lod_texture);
+        }
+        int size = std::max({cw, ch, lod_texture.width, lod_texture.height});
+        Image image = GenImageColor(size, size, BLACK);
+        lod_texture = LoadTextureFromImage(image);
+        UnloadImage(image);
+      }
+      UpdateTextureRec(lod_texture, {0, 0, float(cw), float(ch)},
+                       lod_pixels.data());
+      DrawTexturePro(lod_texture, {0, 0, float(cw), float(ch)},
+                     {float(board_x + i0 * ss), float(board_y + j0 * ss),
+                      float(cw * ss), float(ch * ss)},
+                     {0, 0}, 0, WHITE);
+    }
+    for (int i = i0; i < i1 && ss >= lod_cell_size; ++i) {
+      for (int j = j0; j < j1; ++j) {
         auto pos_x = board_x + i * ss + so;
         auto pos_y = board_y + j * ss + so;
         auto radius = (ss - 2 * so) / 2;
-        if (game.board().is_matched(j, i) && hints) {
+        if (hint && hint->is_matched(j, i)) {
           DrawRectangle(pos_x, pos_y, ss - 2 * so, ss - 2 * so, DARKGRAY);
-        } else if (game.board().is_three(j, i) && hints) {
+        } else if (hint && hint->is_three(j, i)) {
           DrawRectangle(pos_x, pos_y, ss - 2 * so, ss - 2 * so, LIGHTGRAY);
         } else {
           DrawRectangle(pos_x, pos_y, ss - 2 * so, ss - 2 * so, GRAY);
         }
-        switch (game.board().at(j, i)) {
+        auto &tier = quality.tier();
+        if (!tier.shapes) {
+          DrawRectangle(pos_x + ss / 6, pos_y + ss / 6, ss - 2 * so - ss / 3,
+                        ss - 2 * so - ss / 3,
+                        tile_color(game.board().at(j, i), nonacid_colors));
+        }
+        switch (tier.shapes ? game.board().at(j, i) : 0) {
         case 1:
           DrawPoly(Vector2{float(pos_x + radius), float(pos_y + radius)}, 4,
                    radius - mo, 45, nonacid_colors ? PINK : RED);
           break;
         case 2:
-          DrawCircle(pos_x + radius, pos_y + radius, radius - mo,
-                     nonacid_colors ? LIME : GREEN);
+          DrawCircleDetail(
+              Vector2{float(pos_x + radius), float(pos_y + radius)},
+              radius - mo, tier.circle_sides, nonacid_colors ? LIME : GREEN);
           break;
         case 3:
           DrawPoly(Vector2{float(pos_x + radius), float(pos_y + radius)}, 6,
@@ -1085,17 +1027,34 @@ int main() {
           break;
         }
         if (game.board().is_magic(j, i)) {
-          DrawCircleGradient(pos_x + radius, pos_y + radius, ss / 6, WHITE,
-                             BLACK);
+          if (tier.gradients) {
+            DrawCircleGradient(pos_x + radius, pos_y + radius, ss / 6, WHITE,
+                               BLACK);
+          } else {
+            DrawRectangle(pos_x + radius - ss / 8, pos_y + radius - ss / 8,
+                          ss / 4, ss / 4, BLACK);
+          }
         }
         if (game.board().is_magic2(j, i)) {
-          DrawCircleGradient(pos_x + radius, pos_y + radius, ss / 6, WHITE,
-                             DARKPURPLE);
+          if (tier.gradients) {
+            DrawCircleGradient(pos_x + radius, pos_y + radius, ss / 6, WHITE,
+                               DARKPURPLE);
+          } else {
+            DrawRectangle(pos_x + radius - ss / 8, pos_y + radius - ss / 8,
+                          ss / 4, ss / 4, DARKPURPLE);
+          }
         }
       }
     }
+    if (speculation) {
+      // The first group the swap would clear.
+      for (auto [row, col] : speculation->cells) {
+        DrawRectangle(board_x + col * ss, board_y + row * ss, ss, ss,
+                      Color{255, 255, 255, 110});
+      }
+    }
     if (!first_click) {
-      auto pos = GetMousePosition();
+      auto pos = input.mouse();
       pos = Vector2Subtract(pos, Vector2{float(board_x), float(board_y)});
       if (!(pos.x < 0 || pos.y < 0 || pos.x > ss * board_size || pos.y > ss * board_size)) {
         int row = trunc(pos.y / ss);
@@ -1123,8 +1082,9 @@ int main() {
         }
       }
     }
+    EndScissorMode();
     if (input_name) {
-      char c = GetCharPressed();
+      char c = input.next_char();
       if ((std::isalnum(c) || c == '_') && game.name().length() < 22 &&
           !ignore_r) {
         game.name() += c;
@@ -1135,9 +1095,9 @@ int main() {
       DrawText(game.name().c_str(), w / 4, h / 2 - h / 16 + 50, 50, BLACK);
     }
     if (draw_leaderboard && !input_name) {
-      auto wheel_move = GetMouseWheelMove();
-      auto kd = IsKeyPressed(KEY_DOWN);
-      auto ku = IsKeyPressed(KEY_UP);
+      auto wheel_move = input.wheel();
+      auto kd = input.key_pressed(KEY_DOWN);
+      auto ku = input.key_pressed(KEY_UP);
       if (wheel_move == 0) {
         if (kd) {
           wheel_move = -1;
@@ -1154,10 +1114,19 @@ int main() {
       }
       DrawLeaderboard(leaderboard, l_offset, leaderboard_place);
     }
-    DrawText(game.game_stats().c_str(), 3, 0, 30, BLACK);
-    DrawText((fmt::format("Player:\n") + game.name()).c_str(), 3, h - 55, 20,
-             BLACK);
-    ButtonMaker bm(play_sound, ksound, volume);
+    auto &b = game.board();
+    DrawText(texts
+                 .stats(game.counter, b.score, b.normals, b.longers,
+                        b.longests, b.crosses)
+                 .text.c_str(),
+             3, 0, 30, BLACK);
+    DrawText(texts.player(game.name()).text.c_str(), 3, h - 55, 20, BLACK);
+    DrawText(texts.quality(quality).text.c_str(), 3, 200, 20,
+             quality.pinned() ? BLACK : DARKGRAY);
+    if (alloc_overlay) {
+      DrawAllocOverlay(3, 230, alloc_budget);
+    }
+    ButtonMaker bm(play_sound, ksound, volume, texts, input);
     auto start_y = 0;
     auto sound_button = bm.draw_button(
         {float(w - 210), float(h - (start_y += 40))}, "SOUND", true);
@@ -1183,29 +1152,31 @@ int main() {
     }
     play_sound = volume != 0.0f;
     if (particles) {
-      std::vector<Explosion> new_staying;
-      new_staying.reserve(staying.size());
+      // Live particles are compacted in place, keeping the capacity.
+      auto kept = staying.begin();
+      BeginScissorMode(area_x, area_y, area, area);
       for (auto it = staying.begin(); it != staying.end(); ++it) {
         Explosion p = *it;
         DrawRectangle(board_x + p.x * ss + so, board_y + p.y * ss + so,
-                      ss - 2 * so, ss - 2 * so, WHITE);
+                      std::max(1, ss - 2 * so), std::max(1, ss - 2 * so),
+                      WHITE);
         if (p.lifetime > 6) {
           continue;
         }
         p.lifetime += 1;
-        new_staying.push_back(p);
+        *kept++ = p;
       }
-      new_staying.shrink_to_fit();
-      staying = new_staying;
+      EndScissorMode();
+      staying.erase(kept, staying.end());
 
-      std::vector<Particle> new_flying;
-      new_flying.reserve(flying.size());
+      auto kept_flying = flying.begin();
       for (auto it = flying.begin(); it != flying.end(); ++it) {
         Particle p = *it;
         auto c = p.color;
         c.a = 255 - p.lifetime;
         if (p.sides == 0) {
-          DrawCircle(p.x, p.y, ss / 2, c);
+          DrawCircleDetail(Vector2{p.x, p.y}, ss / 2,
+                           quality.tier().circle_sides, c);
         } else {
           DrawPoly(Vector2{float(p.x), float(p.y)}, p.sides, ss / 2, p.a, c);
         }
@@ -1217,30 +1188,40 @@ int main() {
         p.a += p.da;
         p.dy += 1;
         p.lifetime += 1;
-        new_flying.push_back(p);
+        *kept_flying++ = p;
       }
-      new_flying.shrink_to_fit();
-      flying = new_flying;
+      flying.erase(kept_flying, flying.end());
     }
+    if (idle() && !redraw && !input.is_replaying()) {
+      EnableEventWaiting();
+    } else {
+      DisableEventWaiting();
+    }
+    frame_busy = GetTime() - frame_start;
+    frame_animated = !idle();
     EndDrawing();
+    if (input.is_replaying()) {
+      frame_times.push_back(GetTime() - frame_begin);
+    }
     if (!input_name && !game.is_processing()) {
-      if (IsMouseButtonPressed(MOUSE_BUTTON_LEFT)) {
-        auto pos = GetMousePosition();
+      if (input.button_pressed(MOUSE_BUTTON_LEFT)) {
+        auto pos = input.mouse();
         button_flag(pos, particles_button, particles);
         button_flag(pos, hints_button, hints);
         button_flag(pos, acid_button, nonacid_colors);
         button_flag(pos, lbutton, draw_leaderboard);
         if (in_button(pos, rbutton)) {
-          game.new_game();
+          new_game();
           input_name = true;
         }
         if (in_button(pos, load_button)) {
-          game.load();
+          writer.wait();
+          load_game();
         }
         if (in_button(pos, save_button)) {
-          game.save();
+          save_game("save.txt");
         }
-        if (draw_leaderboard) {
+        if (draw_leaderboard || !in_area(pos)) {
           goto outside;
         }
         pos = Vector2Subtract(pos, Vector2{float(board_x), float(board_y)});
@@ -1257,11 +1238,14 @@ int main() {
         } else {
           first_click = true;
           if (((abs(row - saved_row) == 1) ^ (abs(col - saved_col) == 1))) {
-            game.attempt_move(row, col, saved_row, saved_col);
+            play_move(row, col);
           }
         }
-      } else if (IsMouseButtonReleased(MOUSE_BUTTON_LEFT)) {
-        auto pos = GetMousePosition();
+      } else if (input.button_released(MOUSE_BUTTON_LEFT)) {
+        auto pos = input.mouse();
+        if (!in_area(pos)) {
+          goto outside;
+        }
         pos = Vector2Subtract(pos, Vector2{float(board_x), float(board_y)});
         if (pos.x < 0 || pos.y < 0 || pos.x > ss * board_size ||
             pos.y > ss * board_size) {
@@ -1273,27 +1257,27 @@ int main() {
           if (!first_click) {
             first_click = true;
             if (((abs(row - saved_row) == 1) ^ (abs(col - saved_col) == 1))) {
-              game.attempt_move(row, col, saved_row, saved_col);
+              play_move(row, col);
             }
           }
         }
       }
     }
   outside:
-    if (IsKeyPressed(KEY_ENTER) && input_name) {
+    if (input.key_pressed(KEY_ENTER) && input_name) {
       input_name = false;
       if (game.name().empty()) {
         game.name() = "dupa";
       }
-    } else if (IsKeyPressed(KEY_BACKSPACE) && input_name) {
+    } else if (input.key_pressed(KEY_BACKSPACE) && input_name) {
       if (!game.name().empty()) {
         game.name().pop_back();
       }
     } else if (!input_name) {
-      while (int key = GetKeyPressed()) {
+      while (int key = input.next_key()) {
         switch (KeyboardKey(key)) {
         case KEY_R: {
-          game.new_game();
+          new_game();
           ignore_r = true;
           input_name = true;
           break;
@@ -1322,11 +1306,20 @@ int main() {
           break;
         }
         case KEY_S: {
-          game.save();
+          save_game("save.txt");
           break;
         }
         case KEY_O: {
-          game.load();
+          writer.wait();
+          load_game();
+          break;
+        }
+        case KEY_Q: {
+          quality.cycle_pin();
+          break;
+        }
+        case KEY_F3: {
+          alloc_overlay = !alloc_overlay;
           break;
         }
         default:
@@ -1334,6 +1327,19 @@ int main() {
         }
       }
     }
+    // Autosaves go to a file of their own, so that SAVE and LOAD keep the
+    // position the player saved. Copying the board for the writer takes a while on huge
+    // boards, so those wait for the 30 second timer instead of every pause.
+    if (!input_name && !game.is_processing() &&
+        ((idle() && board_size * board_size <= autosave_idle_cells) ||
+         GetTime() - autosave_time > 30)) {
+      autosave_time = GetTime();
+      auto hash = game.board().hash() ^ uint64_t(game.counter);
+      if (hash != autosave_hash) {
+        autosave_hash = hash;
+        save_game("autosave.txt");
+      }
+    }
     if (game.is_finished()) {
       for (auto i = 0; i <= leaderboard.size(); ++i) {
         if (i == leaderboard.size() || leaderboard[i].second < game.board().score) {
@@ -1344,13 +1350,24 @@ int main() {
           break;
         }
       }
-      WriteLeaderboard(leaderboard);
-      game.new_game();
+      WriteLeaderboard(writer, leaderboard);
+      new_game();
       draw_leaderboard = true;
     }
+    live.publish(game);
+  }
+  save_game("save.txt");
+  WriteLeaderboard(writer, leaderboard);
+  if (IsTextureReady(lod_texture)) {
+    UnloadTexture(lod_texture);
+  }
+  if (input.is_replaying()) {
+    PrintFrameTimes(std::move(frame_times));
+    writer.wait();
+    std::filesystem::current_path(start_dir);
+    std::error_code ec;
+    std::filesystem::remove_all(replay_dir, ec);
   }
-  game.save();
-  WriteLeaderboard(leaderboard);
   CloseWindow();
   CloseAudioDevice();
   return 0;
@@ -0,0 +1,191 @@
+#pragma once
+
+// Recordings of game sessions, written by the game with TIAR2_RECORD and
+// read back by its replay mode and by tiar2_render. A recording starts with
+// the session:
+//
+//   tiar2-input 3
+//   seeds <board seed> <particle seed>
+//   window <width> <height>
+//   board <size of new boards>  (version 1 has no events and played 16)
+//   save <length>               the save.txt and leaderboard.txt the game
+//   <text>                      started from, empty if there were none
+//   leaderboard <length>
+//   <text>
+//   rules <length>              the rule set, see rule_set.h (version 3;
+//   <text>                      earlier ones played the default rules)
+//
+// followed by one line per iteration of the game loop:
+//
+//   f <width> <height> <resized> <mouse x> <mouse y> <delta x> <delta y>
+//     <wheel> <buttons> <key count> <keys...> <char count> <chars...>
+//
+// where buttons has bit 0/1/2 for the left button down/pressed/released and
+// bits 3/4/5 for the right one. What the iteration did to the game follows
+// its line:
+//
+//   n                           a new game
+//   l <length>                  a loaded save.txt
+//   <text>
+//   m <row> <col> <row> <col>   a played swap
+//
+// Events before the first frame line happened at start up.
+
+#include <array>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct Session {
+  unsigned game_seed = 0;
+  unsigned particle_seed = 0;
+  int width = 0;
+  int height = 0;
+  int board_size = 0;
+  std::string save;
+  std::string leaderboard;
+  // Empty for the default rule set.
+  std::string rules;
+};
+
+struct FrameInput {
+  int width = 0;
+  int height = 0;
+  bool resized = false;
+  float mouse_x = 0;
+  float mouse_y = 0;
+  float delta_x = 0;
+  float delta_y = 0;
+  float wheel = 0;
+  int buttons = 0;
+  // In the order they were pressed.
+  std::vector<int> keys;
+  std::vector<int> chars;
+};
+
+struct GameEvent {
+  enum Kind : char { new_game = 'n', load = 'l', move = 'm' };
+  Kind kind = new_game;
+  std::array<int, 4> swap{};
+  std::string save;
+
+  GameEvent() = default;
+  GameEvent(Kind kind, std::array<int, 4> swap = {}, std::string save = {})
+      : kind{kind}, swap{swap}, save{std::move(save)} {}
+};
+
+namespace recording {
+
+inline void write_text(std::ostream &out, const char *name,
+                       const std::string &text) {
+  out << name << " " << text.size() << "\n" << text << "\n";
+}
+
+inline bool read_text(std::istream &in, const char *name, std::string &text) {
+  std::string key;
+  size_t size;
+  if (!(in >> key >> size) || key != name || in.get() != '\n') {
+    return false;
+  }
+  text.resize(size);
+  return bool(in.read(text.data(), size));
+}
+
+inline void write_session(std::ostream &out, const Session &s) {
+  out << "tiar2-input 3\n"
+      << "seeds " << s.game_seed << " " << s.particle_seed << "\n"
+      << "window " << s.width << " " << s.height << "\n"
+      << "board " << s.board_size << "\n";
+  write_text(out, "save", s.save);
+  write_text(out, "leaderboard", s.leaderboard);
+  write_text(out, "rules", s.rules);
+}
+
+inline bool read_session(std::istream &in, Session &s) {
+  std::string magic, seeds, window, board = "board";
+  int version = 0;
+  in >> magic >> version >> seeds >> s.game_seed >> s.particle_seed >>
+      window >> s.width >> s.height;
+  s.board_size = 16;
+  if (version >= 2) {
+    in >> board >> s.board_size;
+  }
+  s.rules.clear();
+  return in && magic == "tiar2-input" && version >= 1 && version <= 3 &&
+         seeds == "seeds" && window == "window" && board == "board" &&
+         in.get() == '\n' && read_text(in, "save", s.save) &&
+         read_text(in, "leaderboard", s.leaderboard) &&
+         (version < 3 || read_text(in, "rules", s.rules));
+}
+
+inline void write_frame(std::ostream &out, const FrameInput &f) {
+  out << "f " << f.width << " " << f.height << " " << f.resized << " "
+      << f.mouse_x << " " << f.mouse_y << " " << f.delta_x << " " << f.delta_y
+      << " " << f.wheel << " " << f.buttons << " " << f.keys.size();
+  for (int key : f.keys) {
+    out << " " << key;
+  }
+  out << " " << f.chars.size();
+  for (int c : f.chars) {
+    out << " " << c;
+  }
+  out << "\n";
+}
+
+inline void write_event(std::ostream &out, const GameEvent &e) {
+  switch (e.kind) {
+  case GameEvent::new_game:
+    out << "n\n";
+    break;
+  case GameEvent::load:
+    write_text(out, "l", e.save);
+    break;
+  case GameEvent::move:
+    out << "m " << e.swap[0] << " " << e.swap[1] << " " << e.swap[2] << " "
+        << e.swap[3] << "\n";
+    break;
+  }
+}
+
+enum class Record { end, frame, event };
+
+// Reads the next frame or event, whichever comes first.
+inline Record read_record(std::istream &in, FrameInput &f, GameEvent &e) {
+  char tag = 0;
+  if (!(in >> tag)) {
+    return Record::end;
+  }
+  size_t count;
+  switch (tag) {
+  case 'f':
+    f.keys.clear();
+    f.chars.clear();
+    in >> f.width >> f.height >> f.resized >> f.mouse_x >> f.mouse_y >>
+        f.delta_x >> f.delta_y >> f.wheel >> f.buttons >> count;
+    for (size_t k = 0; k < count && in; ++k) {
+      in >> f.keys.emplace_back();
+    }
+    in >> count;
+    for (size_t k = 0; k < count && in; ++k) {
+      in >> f.chars.emplace_back();
+    }
+    return in ? Record::frame : Record::end;
+  case 'n':
+    e.kind = GameEvent::new_game;
+    return Record::event;
+  case 'l':
+    in.unget();
+    e.kind = GameEvent::load;
+    return read_text(in, "l", e.save) ? Record::event : Record::end;
+  case 'm':
+    e.kind = GameEvent::move;
+    in >> e.swap[0] >> e.swap[1] >> e.swap[2] >> e.swap[3];
+    return in ? Record::event : Record::end;
+  default:
+    return Record::end;
+  }
+}
+
+} // namespace recording
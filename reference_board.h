@@ -0,0 +1,531 @@
+#pragma once
+
+// The rules engine as it was before any performance work: plain vectors and
+// sets, no incremental state. Kept frozen as the reference that faster
+// engines are checked against (see soak.cpp), so don't optimize it; rule
+// changes have to be made here as well.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <set>
+#include <tuple>
+#include <vector>
+
+class ReferenceBoard {
+  std::vector<int> board;
+  std::default_random_engine e1{static_cast<unsigned>(
+      std::chrono::system_clock::now().time_since_epoch().count())};
+  std::uniform_int_distribution<int> uniform_dist{1, 6};
+  std::uniform_int_distribution<int> uniform_dist_2;
+  std::uniform_int_distribution<int> uniform_dist_3;
+  std::uniform_int_distribution<int> coin{1, 42};
+  std::uniform_int_distribution<int> coin2{1, 69};
+
+  size_t w;
+  size_t h;
+  std::set<std::pair<int, int>> magic_tiles;
+  std::set<std::pair<int, int>> magic_tiles2;
+  std::vector<std::tuple<int, int, int>> rm_i;
+  std::vector<std::tuple<int, int, int>> rm_j;
+  std::vector<std::pair<int, int>> rm_b;
+
+public:
+  int width() const { return w; }
+  int height() const { return h; }
+  int score{};
+  int normals{};
+  int longers{};
+  int longests{};
+  int crosses{};
+  ReferenceBoard(size_t _w, size_t _h) : w{_w}, h{_h} {
+    board.resize(w * h);
+    std::fill(std::begin(board), std::end(board), 0);
+    uniform_dist_2 = std::uniform_int_distribution<int>(0, w - 1);
+    uniform_dist_3 = std::uniform_int_distribution<int>(0, h - 1);
+  }
+  bool is_magic(int x, int y) const { return magic_tiles.contains({x, y}); }
+  bool is_magic2(int x, int y) const {
+    return magic_tiles2.contains({x, y});
+  }
+  void swap(int x1, int y1, int x2, int y2) {
+    auto tmp = at(x1, y1);
+    at(x1, y1) = at(x2, y2);
+    at(x2, y2) = tmp;
+
+    if (is_magic(x1, y1)) {
+      magic_tiles.erase({x1, y1});
+      magic_tiles.insert({x2, y2});
+    }
+
+    if (is_magic(x2, y2)) {
+      magic_tiles.erase({x2, y2});
+      magic_tiles.insert({x1, y1});
+    }
+
+    if (is_magic2(x1, y1)) {
+      magic_tiles2.erase({x1, y1});
+      magic_tiles2.insert({x2, y2});
+    }
+
+    if (is_magic2(x2, y2)) {
+      magic_tiles2.erase({x2, y2});
+      magic_tiles2.insert({x1, y1});
+    }
+  }
+  void fill() {
+    for (auto &x : board) {
+      x = uniform_dist(e1);
+    }
+  }
+  int &at(int a, int b) { return board[a * h + b]; }
+  int at(int a, int b) const { return board[a * h + b]; }
+  bool reasonable_coord(int i, int j) const {
+    return i >= 0 && i < w && j >= 0 && j < h;
+  }
+  void remove_trios() {
+    std::vector<std::tuple<int, int, int>> remove_i;
+    std::vector<std::tuple<int, int, int>> remove_j;
+    for (int i = 0; i < w; ++i) {
+      for (int j = 0; j < h; ++j) {
+        int offset_j = 1;
+        int offset_i = 1;
+        while (j + offset_j < h && at(i, j) == at(i, j + offset_j)) {
+          offset_j += 1;
+        }
+        if (offset_j > 2) {
+          remove_i.push_back({i, j, offset_j});
+        }
+        while (i + offset_i < w && at(i, j) == at(i + offset_i, j)) {
+          offset_i += 1;
+        }
+        if (offset_i > 2) {
+          remove_j.push_back({i, j, offset_i});
+        }
+      }
+    }
+    for (auto t : remove_i) {
+      int i = std::get<0>(t);
+      int j = std::get<1>(t);
+      int offset = std::get<2>(t);
+      if (offset == 4) {
+        j = 0;
+        offset = h;
+        longers += 1;
+        normals = std::max(0, normals - 1);
+      }
+      for (int jj = j; jj < j + offset; ++jj) {
+        at(i, jj) = 0;
+        if (is_magic(i, jj)) {
+          score -= 3;
+          magic_tiles.erase({i, jj});
+        }
+        if (is_magic2(i, jj)) {
+          score += 3;
+          magic_tiles2.erase({i, jj});
+        }
+        score += 1;
+      }
+      if (offset == 5) {
+        for (int i = 0; i < w; ++i) {
+          at(uniform_dist_2(e1), uniform_dist_3(e1)) = 0;
+          score += 1;
+        }
+        longests += 1;
+        normals = std::max(0, normals - 1);
+      }
+      normals += 1;
+    }
+    for (auto t : remove_j) {
+      int i = std::get<0>(t);
+      int j = std::get<1>(t);
+      int offset = std::get<2>(t);
+      if (offset == 4) {
+        i = 0;
+        offset = w;
+        longers += 1;
+        normals = std::max(0, normals - 1);
+      }
+      for (int ii = i; ii < i + offset; ++ii) {
+        at(ii, j) = 0;
+        if (is_magic(ii, j)) {
+          score -= 3;
+          magic_tiles.erase({ii, j});
+        }
+        if (is_magic2(ii, j)) {
+          score += 3;
+          magic_tiles2.erase({ii, j});
+        }
+        score += 1;
+      }
+      if (offset == 5) {
+        for (int i = 0; i < w; ++i) {
+          at(uniform_dist_2(e1), uniform_dist_3(e1)) = 0;
+          score += 1;
+        }
+        longests += 1;
+        normals = std::max(0, normals - 1);
+      }
+      normals += 1;
+    }
+    std::set<std::pair<int, int>> seen;
+    for (int i = 0; i < int(remove_i.size()); ++i) {
+      for (int j = 0; j < int(remove_j.size()); ++j) {
+        auto t1 = remove_i[i];
+        auto t2 = remove_j[j];
+        auto i1 = std::get<0>(t1);
+        auto j1 = std::get<1>(t1);
+        auto o1 = std::get<2>(t1);
+        auto i2 = std::get<0>(t2);
+        auto j2 = std::get<1>(t2);
+        auto o2 = std::get<2>(t2);
+        // One cross per cell, however many suffix entries meet there.
+        if (i1 >= i2 && i1 < (i2 + o2) && j2 >= j1 && j2 < (j1 + o1) &&
+            seen.insert({i1, j2}).second) {
+          for (int m = -1; m < 2; ++m) {
+            for (int n = -1; n < 2; ++n) {
+              if (reasonable_coord(i1 + m, j1 + n)) {
+                at(i1 + m, j1 + n) = 0;
+                score += 1;
+              }
+            }
+          }
+          crosses += 1;
+          normals = std::max(0, normals - 2);
+        }
+      }
+    }
+  }
+  void fill_up() {
+    int curr_i = -1;
+    for (int i = 0; i < w; ++i) {
+      for (int j = 0; j < h; ++j) {
+        if (at(i, j) == 0) {
+          curr_i = i;
+          while (curr_i < w - 1 && at(curr_i + 1, j) == 0) {
+            curr_i += 1;
+          }
+          for (int k = curr_i; k >= 0; --k) {
+            if (at(k, j) != 0) {
+              at(curr_i, j) = at(k, j);
+              if (is_magic(k, j)) {
+                magic_tiles.erase({k, j});
+                magic_tiles.insert({curr_i, j});
+              }
+              if (is_magic2(k, j)) {
+                magic_tiles2.erase({k, j});
+                magic_tiles2.insert({curr_i, j});
+              }
+              curr_i -= 1;
+            }
+          }
+          for (int k = curr_i; k >= 0; --k) {
+            at(k, j) = uniform_dist(e1);
+            if (coin(e1) == 1) {
+              magic_tiles.insert({k, j});
+            }
+            if (coin2(e1) == 1) {
+              magic_tiles2.insert({k, j});
+            }
+          }
+        }
+      }
+    }
+  }
+  void stabilize() {
+    auto old_board = board;
+    do {
+      old_board = board;
+      remove_trios();
+      fill_up();
+    } while (board != old_board);
+  }
+  void seed(unsigned s) { e1.seed(s); }
+  void zero() {
+    score = 0;
+    normals = 0;
+    longers = 0;
+    longests = 0;
+    crosses = 0;
+  }
+  // New interface starts here
+  std::vector<std::tuple<int, int, int>> remove_one_thing() {
+    std::vector<std::tuple<int, int, int>> res;
+    if (!rm_i.empty()) {
+      auto t = rm_i.back();
+      int i = std::get<0>(t);
+      int j = std::get<1>(t);
+      int offset = std::get<2>(t);
+      if (offset == 4) {
+        j = 0;
+        offset = h;
+        longers += 1;
+        normals = std::max(0, normals - 1);
+      }
+      for (int jj = j; jj < j + offset; ++jj) {
+        res.emplace_back(i, jj, at(i, jj));
+        at(i, jj) = 0;
+        if (is_magic(i, jj)) {
+          score -= 3;
+          magic_tiles.erase({i, jj});
+        }
+        if (is_magic2(i, jj)) {
+          score += 3;
+          magic_tiles2.erase({i, jj});
+        }
+        score += 1;
+      }
+      if (offset == 5) {
+        std::set<std::pair<int, int>> r;
+        for (int i = 0; i < w; ++i) {
+          int x, y;
+          do {
+            x = uniform_dist_2(e1);
+            y = uniform_dist_3(e1);
+          } while (r.contains({x, y}));
+          r.insert({x, y});
+          res.emplace_back(x, y, at(x, y));
+          at(x, y) = 0;
+          score += 1;
+        }
+        longests += 1;
+        normals = std::max(0, normals - 1);
+      }
+      normals += 1;
+      rm_i.pop_back();
+      return res;
+    }
+    if (!rm_j.empty()) {
+      auto t = rm_j.back();
+      int i = std::get<0>(t);
+      int j = std::get<1>(t);
+      int offset = std::get<2>(t);
+      if (offset == 4) {
+        i = 0;
+        offset = w;
+        longers += 1;
+        normals = std::max(0, normals - 1);
+      }
+      for (int ii = i; ii < i + offset; ++ii) {
+        res.emplace_back(ii, j, at(ii, j));
+        at(ii, j) = 0;
+        if (is_magic(ii, j)) {
+          score -= 3;
+          magic_tiles.erase({ii, j});
+        }
+        if (is_magic2(ii, j)) {
+          score += 3;
+          magic_tiles2.erase({ii, j});
+        }
+        score += 1;
+      }
+      if (offset == 5) {
+        std::set<std::pair<int, int>> r;
+        for (int i = 0; i < w; ++i) {
+          int x, y;
+          do {
+            x = uniform_dist_2(e1);
+            y = uniform_dist_3(e1);
+          } while (r.contains({x, y}));
+          r.insert({x, y});
+          res.emplace_back(x, y, at(x, y));
+          at(x, y) = 0;
+          score += 1;
+        }
+        longests += 1;
+        normals = std::max(0, normals - 1);
+      }
+      normals += 1;
+      rm_j.pop_back();
+      return res;
+    }
+    if (!rm_b.empty()) {
+      auto t = rm_b.back();
+      int i = std::get<0>(t);
+      int j = std::get<1>(t);
+      for (int m = -2; m < 3; ++m) {
+        for (int n = -2; n < 3; ++n) {
+          if (reasonable_coord(i + m, j + n)) {
+            res.emplace_back(i + m, j + n, at(i + m, j + n));
+            at(i + m, j + n) = 0;
+            score += 1;
+          }
+        }
+      }
+      crosses += 1;
+      normals = std::max(0, normals - 2);
+      rm_b.pop_back();
+      return res;
+    }
+    return res;
+  }
+  void prepare_removals() {
+    rm_i.clear();
+    rm_j.clear();
+    rm_b.clear();
+    for (int i = 0; i < w; ++i) {
+      for (int j = 0; j < h; ++j) {
+        int offset_j = 1;
+        int offset_i = 1;
+        while (j + offset_j < h && at(i, j) == at(i, j + offset_j)) {
+          offset_j += 1;
+        }
+        if (offset_j > 2) {
+          rm_i.emplace_back(i, j, offset_j);
+        }
+        while (i + offset_i < w && at(i, j) == at(i + offset_i, j)) {
+          offset_i += 1;
+        }
+        if (offset_i > 2) {
+          rm_j.emplace_back(i, j, offset_i);
+        }
+      }
+    }
+    for (int i = 0; i < int(rm_i.size()); ++i) {
+      for (int j = 0; j < int(rm_j.size()); ++j) {
+        auto t1 = rm_i[i];
+        auto t2 = rm_j[j];
+        auto i1 = std::get<0>(t1);
+        auto j1 = std::get<1>(t1);
+        auto o1 = std::get<2>(t1);
+        auto i2 = std::get<0>(t2);
+        auto j2 = std::get<1>(t2);
+        auto o2 = std::get<2>(t2);
+        if (i1 >= i2 && i1 < (i2 + o2) && j2 >= j1 && j2 < (j1 + o1)) {
+          rm_b.emplace_back(i1, j2);
+        }
+      }
+    }
+    auto sorter = [](auto &t1, auto &t2) {
+      auto i1 = std::get<0>(t1);
+      auto i2 = std::get<0>(t2);
+      return i1 > i2;
+    };
+    std::sort(std::begin(rm_i), std::end(rm_i), sorter);
+    std::sort(std::begin(rm_j), std::end(rm_j), sorter);
+    // One cross per cell, the topmost, then leftmost, popped first.
+    std::sort(std::begin(rm_b), std::end(rm_b), std::greater<>());
+    rm_b.erase(std::unique(std::begin(rm_b), std::end(rm_b)), std::end(rm_b));
+  }
+  bool has_removals() { return rm_i.size() + rm_j.size() + rm_b.size(); }
+  // Rules added after the original engine, written the obvious way: every
+  // query rescans the board.
+  bool makes_run(int i, int j) const {
+    int c = at(i, j);
+    if (c == 0) {
+      return false;
+    }
+    int n = 1;
+    for (int k = i - 1; k >= 0 && at(k, j) == c; --k) {
+      n += 1;
+    }
+    for (int k = i + 1; k < int(w) && at(k, j) == c; ++k) {
+      n += 1;
+    }
+    if (n > 2) {
+      return true;
+    }
+    n = 1;
+    for (int k = j - 1; k >= 0 && at(i, k) == c; --k) {
+      n += 1;
+    }
+    for (int k = j + 1; k < int(h) && at(i, k) == c; ++k) {
+      n += 1;
+    }
+    return n > 2;
+  }
+  bool is_legal_swap(int x1, int y1, int x2, int y2) {
+    if (!reasonable_coord(x1, y1) || !reasonable_coord(x2, y2) ||
+        std::abs(x1 - x2) + std::abs(y1 - y2) != 1 ||
+        at(x1, y1) == at(x2, y2)) {
+      return false;
+    }
+    std::swap(at(x1, y1), at(x2, y2));
+    bool res = makes_run(x1, y1) || makes_run(x2, y2);
+    std::swap(at(x1, y1), at(x2, y2));
+    return res;
+  }
+  bool has_any_move() {
+    for (int i = 0; i < w; ++i) {
+      for (int j = 0; j < h; ++j) {
+        if (is_legal_swap(i, j, i + 1, j) || is_legal_swap(i, j, i, j + 1)) {
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+  void place(const std::vector<std::tuple<int, bool, bool>> &tiles) {
+    magic_tiles.clear();
+    magic_tiles2.clear();
+    for (int i = 0; i < w; ++i) {
+      for (int j = 0; j < h; ++j) {
+        auto [c, m1, m2] = tiles[i * h + j];
+        at(i, j) = c;
+        if (m1) {
+          magic_tiles.insert({i, j});
+        }
+        if (m2) {
+          magic_tiles2.insert({i, j});
+        }
+      }
+    }
+  }
+  bool reshuffle(int attempts = 100) {
+    std::vector<std::tuple<int, bool, bool>> tiles;
+    for (int i = 0; i < w; ++i) {
+      for (int j = 0; j < h; ++j) {
+        tiles.emplace_back(at(i, j), is_magic(i, j), is_magic2(i, j));
+      }
+    }
+    std::vector<std::tuple<int, bool, bool>> pool = tiles;
+    for (int k = 0; k < attempts; ++k) {
+      std::shuffle(std::begin(pool), std::end(pool), e1);
+      bool placed = true;
+      for (int c = 0; c < w * h && placed; ++c) {
+        int i = c / h;
+        int j = c % h;
+        int up = i >= 2 && at(i - 1, j) == at(i - 2, j) ? at(i - 1, j) : 0;
+        int left = j >= 2 && at(i, j - 1) == at(i, j - 2) ? at(i, j - 1) : 0;
+        placed = false;
+        for (int p = c; p < w * h; ++p) {
+          int t = std::get<0>(pool[p]);
+          if (t != up && t != left) {
+            std::swap(pool[c], pool[p]);
+            at(i, j) = t;
+            placed = true;
+            break;
+          }
+        }
+      }
+      if (placed) {
+        place(pool);
+        if (has_any_move()) {
+          return true;
+        }
+      }
+    }
+    place(tiles);
+    return false;
+  }
+  int settle() {
+    int groups = 0;
+    while (true) {
+      if (!has_removals()) {
+        prepare_removals();
+      }
+      if (!has_removals()) {
+        break;
+      }
+      remove_one_thing();
+      fill_up();
+      groups += 1;
+    }
+    if (!has_any_move()) {
+      reshuffle();
+    }
+    return groups;
+  }
+};
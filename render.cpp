@@ -0,0 +1,632 @@
+// Offline renderer. Plays a recording of the game (see recording.h) through
+// the engine and draws every loop iteration on the CPU the way the game draws
+// its board: tile shapes, magic markers, explosions and flying particles.
+// Frames are simulated in order and rasterized and encoded on all cores. No
+// window or GPU is needed.
+//
+// Usage: tiar2_render <recording> [key=value...]
+//
+//   out=frames    directory for frame_00000.png, frame_00001.png, ...
+//   raw=FILE      raw RGBA frames back to back instead, "-" for stdout, e.g.
+//                 | ffmpeg -f rawvideo -pix_fmt rgba -s 1280x800 -r 60 -i -
+//   width=N       frame size, the recorded window size by default
+//   height=N
+//   first=0       first frame written
+//   count=N       frames written, all by default
+//   particles=1   explosions and flying particles
+//   nonacid=0     the non-acid palette
+//   level=3       PNG compression level, 0..9
+//   threads=N     worker threads, 1..1024, all cores by default
+//
+// The HUD, buttons and text are not drawn, and the view always shows the
+// whole board.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <numbers>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include <fmt/format.h>
+#include <zlib.h>
+
+#include "board.h"
+#include "game.h"
+#include "recording.h"
+#include "rule_set.h"
+
+// The raylib colours the game draws with.
+struct Color {
+  uint8_t r, g, b, a;
+};
+constexpr Color WHITE{255, 255, 255, 255};
+constexpr Color BLACK{0, 0, 0, 255};
+constexpr Color RAYWHITE{245, 245, 245, 255};
+constexpr Color GRAY{130, 130, 130, 255};
+constexpr Color DARKPURPLE{112, 31, 126, 255};
+constexpr Color RED{230, 41, 55, 255};
+constexpr Color PINK{255, 109, 194, 255};
+constexpr Color GREEN{0, 228, 48, 255};
+constexpr Color LIME{0, 158, 47, 255};
+constexpr Color BLUE{0, 121, 241, 255};
+constexpr Color SKYBLUE{102, 191, 255, 255};
+constexpr Color ORANGE{255, 161, 0, 255};
+constexpr Color GOLD{255, 203, 0, 255};
+constexpr Color MAGENTA{255, 0, 255, 255};
+constexpr Color PURPLE{200, 122, 255, 255};
+constexpr Color YELLOW{253, 249, 0, 255};
+constexpr Color BEIGE{211, 176, 131, 255};
+
+Color tile_color(int tile, bool nonacid_colors) {
+  switch (tile) {
+  case 1:
+    return nonacid_colors ? PINK : RED;
+  case 2:
+    return nonacid_colors ? LIME : GREEN;
+  case 3:
+    return nonacid_colors ? SKYBLUE : BLUE;
+  case 4:
+    return nonacid_colors ? GOLD : ORANGE;
+  case 5:
+    return nonacid_colors ? PURPLE : MAGENTA;
+  case 6:
+    return nonacid_colors ? BEIGE : YELLOW;
+  default:
+    return BLACK;
+  }
+}
+
+// Sides of the particle of a tile, 0 for a circle.
+int tile_sides(int tile) {
+  constexpr int sides[] = {0, 4, 0, 6, 3, 5, 4};
+  return tile >= 0 && tile <= 6 ? sides[tile] : 0;
+}
+
+// Same as in the game.
+constexpr int lod_cell_size = 6;
+
+// An RGBA image with the raylib primitives the board needs. Shapes cover the
+// pixels whose centres are inside them and blend over what is there.
+class Canvas {
+  int _w;
+  int _h;
+  std::vector<uint8_t> _pixels;
+  // Scissor rectangle.
+  int _x0 = 0;
+  int _y0 = 0;
+  int _x1;
+  int _y1;
+
+  void blend(int x, int y, Color c) {
+    uint8_t *p = &_pixels[(size_t(y) * _w + x) * 4];
+    if (c.a == 255) {
+      p[0] = c.r;
+      p[1] = c.g;
+      p[2] = c.b;
+      return;
+    }
+    p[0] = (c.r * c.a + p[0] * (255 - c.a) + 127) / 255;
+    p[1] = (c.g * c.a + p[1] * (255 - c.a) + 127) / 255;
+    p[2] = (c.b * c.a + p[2] * (255 - c.a) + 127) / 255;
+  }
+  // Rows whose centres are in [top, bottom), clipped.
+  std::pair<int, int> rows(float top, float bottom) const {
+    return {std::max(_y0, int(std::ceil(top - 0.5f))),
+            std::min(_y1, int(std::ceil(bottom - 0.5f)))};
+  }
+  std::pair<int, int> columns(float left, float right) const {
+    return {std::max(_x0, int(std::ceil(left - 0.5f))),
+            std::min(_x1, int(std::ceil(right - 0.5f)))};
+  }
+
+public:
+  Canvas(int w, int h)
+      : _w{w}, _h{h}, _pixels(size_t(w) * h * 4), _x1{w}, _y1{h} {}
+  int width() const { return _w; }
+  int height() const { return _h; }
+  const std::vector<uint8_t> &pixels() const { return _pixels; }
+
+  void clear(Color c) {
+    for (size_t k = 0; k < _pixels.size(); k += 4) {
+      _pixels[k] = c.r;
+      _pixels[k + 1] = c.g;
+      _pixels[k + 2] = c.b;
+      _pixels[k + 3] = 255;
+    }
+  }
+  void scissor(int x, int y, int w, int h) {
+    _x0 = std::max(0, x);
+    _y0 = std::max(0, y);
+    _x1 = std::min(_w, x + w);
+    _y1 = std::min(_h, y + h);
+  }
+  void no_scissor() { scissor(0, 0, _w, _h); }
+
+  void rectangle(int x, int y, int w, int h, Color c) {
+    for (int py = std::max(_y0, y); py < std::min(_y1, y + h); ++py) {
+      for (int px = std::max(_x0, x); px < std::min(_x1, x + w); ++px) {
+        blend(px, py, c);
+      }
+    }
+  }
+  // A regular polygon like DrawPoly(): the first vertex at rotation degrees,
+  // clockwise on screen.
+  void poly(float cx, float cy, int sides, float radius, float rotation,
+            Color c) {
+    if (sides < 3) {
+      return;
+    }
+    float vx[16], vy[16];
+    sides = std::min(sides, 16);
+    for (int k = 0; k < sides; ++k) {
+      float angle = (rotation + 360.0f * k / sides) * std::numbers::pi_v<float> /
+                    180;
+      vx[k] = cx + std::cos(angle) * radius;
+      vy[k] = cy + std::sin(angle) * radius;
+    }
+    auto [top, bottom] =
+        rows(*std::min_element(vy, vy + sides), *std::max_element(vy, vy + sides));
+    for (int py = top; py < bottom; ++py) {
+      // The polygon is convex, so a row crosses it in one span.
+      float y = py + 0.5f;
+      float left = INFINITY;
+      float right = -INFINITY;
+      for (int k = 0; k < sides; ++k) {
+        int l = (k + 1) % sides;
+        if ((vy[k] <= y) == (vy[l] <= y)) {
+          continue;
+        }
+        float x = vx[k] + (y - vy[k]) * (vx[l] - vx[k]) / (vy[l] - vy[k]);
+        left = std::min(left, x);
+        right = std::max(right, x);
+      }
+      auto [x0, x1] = columns(left, right);
+      for (int px = x0; px < x1; ++px) {
+        blend(px, py, c);
+      }
+    }
+  }
+  void circle(float cx, float cy, float radius, Color c) {
+    circle_gradient(cx, cy, radius, c, c);
+  }
+  // Inner at the centre to outer at the edge, like DrawCircleGradient().
+  void circle_gradient(float cx, float cy, float radius, Color inner,
+                       Color outer) {
+    if (radius <= 0) {
+      return;
+    }
+    auto [top, bottom] = rows(cy - radius, cy + radius);
+    for (int py = top; py < bottom; ++py) {
+      float dy = py + 0.5f - cy;
+      float half = std::sqrt(std::max(0.0f, radius * radius - dy * dy));
+      auto [x0, x1] = columns(cx - half, cx + half);
+      for (int px = x0; px < x1; ++px) {
+        float t = std::min(1.0f, std::hypot(px + 0.5f - cx, dy) / radius);
+        auto mix = [t](uint8_t a, uint8_t b) {
+          return uint8_t(a + (b - a) * t + 0.5f);
+        };
+        blend(px, py,
+              {mix(inner.r, outer.r), mix(inner.g, outer.g),
+               mix(inner.b, outer.b), mix(inner.a, outer.a)});
+      }
+    }
+  }
+};
+
+// PNG of an RGBA canvas, compressed with zlib.
+std::string EncodePng(const Canvas &canvas, int level) {
+  int w = canvas.width();
+  int h = canvas.height();
+  const auto &pixels = canvas.pixels();
+  // Every row with the Sub filter: bytes minus the bytes of the pixel to
+  // the left, which suits the flat areas of the board.
+  size_t stride = size_t(w) * 4 + 1;
+  std::vector<uint8_t> filtered(stride * h);
+  for (int y = 0; y < h; ++y) {
+    uint8_t *out = &filtered[stride * y];
+    const uint8_t *in = &pixels[size_t(w) * 4 * y];
+    out[0] = 1;
+    for (size_t k = 0; k < size_t(w) * 4; ++k) {
+      out[k + 1] = in[k] - (k >= 4 ? in[k - 4] : 0);
+    }
+  }
+  uLongf size = compressBound(filtered.size());
+  std::vector<uint8_t> compressed(size);
+  compress2(compressed.data(), &size, filtered.data(), filtered.size(), level);
+
+  std::string png = "\x89PNG\r\n\x1a\n";
+  auto chunk = [&png](const char *type, const uint8_t *data, size_t length) {
+    auto be32 = [&png](uint32_t v) {
+      png += char(v >> 24);
+      png += char(v >> 16);
+      png += char(v >> 8);
+      png += char(v);
+    };
+    be32(length);
+    size_t start = png.size();
+    png.append(type, 4);
+    png.append(reinterpret_cast<const char *>(data), length);
+    be32(crc32(0, reinterpret_cast<const Bytef *>(png.data() + start),
+               png.size() - start));
+  };
+  uint8_t header[13] = {uint8_t(w >> 24), uint8_t(w >> 16), uint8_t(w >> 8),
+                        uint8_t(w),       uint8_t(h >> 24), uint8_t(h >> 16),
+                        uint8_t(h >> 8),  uint8_t(h),
+                        8, 6, 0, 0, 0};
+  chunk("IHDR", header, sizeof header);
+  chunk("IDAT", compressed.data(), size);
+  chunk("IEND", nullptr, 0);
+  return png;
+}
+
+struct Particle {
+  float dx = 0;
+  float dy = 0;
+  float da = 0;
+  float x = 0;
+  float y = 0;
+  float a = 0;
+  Color color;
+  int lifetime = 0;
+  int sides = 0;
+};
+
+struct Explosion {
+  int x = 0;
+  int y = 0;
+  int lifetime = 0;
+};
+
+// What one frame shows.
+struct Scene {
+  int n = 0;
+  // Tile and magic bits of every cell, row by row.
+  std::vector<uint8_t> tiles;
+  std::vector<uint8_t> magic;
+  std::vector<Particle> flying;
+  std::vector<Explosion> staying;
+};
+
+// Where the game puts the board in a w x h window with the whole board in
+// view.
+struct Layout {
+  int area_x, area_y, area, ss, board_x, board_y;
+
+  Layout(int w, int h, int n) {
+    int s = std::min(w, h);
+    int margin = 10;
+    area = s - 2 * margin;
+    area_x = w / 2 - s / 2 + margin;
+    area_y = h / 2 - s / 2 + margin;
+    ss = std::max(1, area / std::max(n, 1));
+    board_x = area_x + area / 2 - int(n / 2.0f * ss);
+    board_y = area_y + area / 2 - int(n / 2.0f * ss);
+  }
+};
+
+// Steps the game on the frames the game loop would, and moves the particles
+// the way it does.
+class Simulation {
+  BasicGame<Board> _game;
+  int _w;
+  int _h;
+  bool _particles;
+  bool _nonacid;
+  int _frame_counter = 0;
+  std::vector<Particle> _flying;
+  std::vector<Explosion> _staying;
+  std::default_random_engine _eng;
+  std::uniform_int_distribution<int> _dd{-10, 10};
+
+public:
+  Simulation(const Session &s, const Rules &rules, int w, int h,
+             bool particles, bool nonacid)
+      : _game(std::max(s.board_size, 3), rules), _w{w}, _h{h},
+        _particles{particles}, _nonacid{nonacid}, _eng{s.particle_seed} {
+    _game.seed(s.game_seed);
+  }
+
+  void apply(const GameEvent &e) {
+    switch (e.kind) {
+    case GameEvent::new_game:
+      _game.new_game();
+      break;
+    case GameEvent::load: {
+      std::istringstream in(e.save);
+      _game.load(in);
+      break;
+    }
+    case GameEvent::move:
+      _game.attempt_move(e.swap[0], e.swap[1], e.swap[2], e.swap[3]);
+      break;
+    }
+  }
+
+  // Runs one iteration of the game loop and returns what it draws.
+  void frame(Scene &scene) {
+    _frame_counter = _frame_counter == 60 ? 0 : _frame_counter + 1;
+    auto &b = _game.board();
+    int n = b.width();
+    Layout l(_w, _h, n);
+    if (_game.is_processing() && _frame_counter % 6 == 0) {
+      auto removed = _game.step();
+      for (auto [row, col, tile] : _particles ? removed : decltype(removed){}) {
+        _flying.push_back({float(_dd(_eng)), float(_dd(_eng)),
+                           float(_dd(_eng)),
+                           float(col * l.ss + l.board_x + l.ss / 2),
+                           float(row * l.ss + l.board_y + l.ss / 2), 0,
+                           tile_color(tile, _nonacid), 0, tile_sides(tile)});
+        _staying.push_back({col, row, 0});
+      }
+    }
+    scene.n = n;
+    scene.tiles.resize(n * n);
+    scene.magic.resize(n * n);
+    for (int j = 0; j < n; ++j) {
+      for (int i = 0; i < n; ++i) {
+        scene.tiles[j * n + i] = b.at(j, i);
+        scene.magic[j * n + i] = b.is_magic(j, i) | b.is_magic2(j, i) << 1;
+      }
+    }
+    scene.flying = _flying;
+    scene.staying = _staying;
+
+    std::erase_if(_staying, [](Explosion &p) { return p.lifetime++ > 6; });
+    std::erase_if(_flying, [this](Particle &p) {
+      p.y += p.dy;
+      if (p.y > _h || p.x < 0 || p.x > _w || p.lifetime > 254) {
+        return true;
+      }
+      p.x += p.dx;
+      p.a += p.da;
+      p.dy += 1;
+      p.lifetime += 1;
+      return false;
+    });
+  }
+};
+
+void Draw(const Scene &scene, bool nonacid_colors, Canvas &canvas) {
+  int n = scene.n;
+  Layout l(canvas.width(), canvas.height(), n);
+  int ss = l.ss;
+  int so = 2;
+  float mo = 0.5f;
+  canvas.clear(RAYWHITE);
+  canvas.scissor(l.area_x, l.area_y, l.area, l.area);
+  canvas.rectangle(l.board_x, l.board_y, ss * n, ss * n, BLACK);
+  for (int j = 0; j < n; ++j) {
+    for (int i = 0; i < n; ++i) {
+      int tile = scene.tiles[j * n + i];
+      if (ss < lod_cell_size) {
+        canvas.rectangle(l.board_x + i * ss, l.board_y + j * ss, ss, ss,
+                         tile_color(tile, nonacid_colors));
+        continue;
+      }
+      int pos_x = l.board_x + i * ss + so;
+      int pos_y = l.board_y + j * ss + so;
+      int radius = (ss - 2 * so) / 2;
+      float cx = pos_x + radius;
+      float cy = pos_y + radius;
+      canvas.rectangle(pos_x, pos_y, ss - 2 * so, ss - 2 * so, GRAY);
+      Color c = tile_color(tile, nonacid_colors);
+      switch (tile) {
+      case 1:
+        canvas.poly(cx, cy, 4, radius - mo, 45, c);
+        break;
+      case 2:
+        canvas.circle(cx, cy, radius - mo, c);
+        break;
+      case 3:
+        canvas.poly(cx, cy, 6, radius - mo, 30, c);
+        break;
+      case 4:
+        canvas.poly(cx, cy + ss / 12, 3, radius - mo, 180, c);
+        break;
+      case 5:
+        canvas.poly(cx, cy + ss / 16, 5, radius - mo, 180, c);
+        break;
+      case 6:
+        canvas.poly(cx, cy, 4, radius - mo, 0, c);
+        break;
+      default:
+        break;
+      }
+      if (scene.magic[j * n + i] & 1) {
+        canvas.circle_gradient(cx, cy, ss / 6, WHITE, BLACK);
+      }
+      if (scene.magic[j * n + i] & 2) {
+        canvas.circle_gradient(cx, cy, ss / 6, WHITE, DARKPURPLE);
+      }
+    }
+  }
+  for (const Explosion &p : scene.staying) {
+    canvas.rectangle(l.board_x + p.x * ss + so, l.board_y + p.y * ss + so,
+                     std::max(1, ss - 2 * so), std::max(1, ss - 2 * so),
+                     WHITE);
+  }
+  canvas.no_scissor();
+  for (const Particle &p : scene.flying) {
+    Color c = p.color;
+    c.a = 255 - p.lifetime;
+    if (p.sides == 0) {
+      canvas.circle(p.x, p.y, ss / 2, c);
+    } else {
+      canvas.poly(p.x, p.y, p.sides, ss / 2, p.a, c);
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  std::string out_dir = "frames";
+  std::string raw_path;
+  int width = 0;
+  int height = 0;
+  long long first = 0;
+  long long count = -1;
+  bool particles = true;
+  bool nonacid = false;
+  int level = 3;
+  int threads = std::max(1, int(std::thread::hardware_concurrency()));
+  auto usage = [] {
+    std::cerr << "Usage: tiar2_render <recording> [out=DIR] [raw=FILE|-] "
+                 "[width=N] [height=N] [first=N] [count=N] [particles=0|1] "
+                 "[nonacid=0|1] [level=0..9] [threads=1..1024]\n";
+    return 1;
+  };
+  if (argc < 2) {
+    return usage();
+  }
+  try {
+    for (int a = 2; a < argc; ++a) {
+      std::string arg = argv[a];
+      auto eq = arg.find('=');
+      if (eq == std::string::npos) {
+        return usage();
+      }
+      std::string key = arg.substr(0, eq);
+      std::string value = arg.substr(eq + 1);
+      if (key == "out") {
+        out_dir = value;
+      } else if (key == "raw") {
+        raw_path = value;
+      } else if (key == "width") {
+        width = std::stoi(value);
+      } else if (key == "height") {
+        height = std::stoi(value);
+      } else if (key == "first") {
+        first = std::stoll(value);
+      } else if (key == "count") {
+        count = std::stoll(value);
+      } else if (key == "particles") {
+        particles = std::stoi(value) != 0;
+      } else if (key == "nonacid") {
+        nonacid = std::stoi(value) != 0;
+      } else if (key == "level") {
+        level = std::stoi(value);
+      } else if (key == "threads") {
+        threads = std::stoi(value);
+      } else {
+        return usage();
+      }
+    }
+  } catch (const std::exception &) {
+    return usage();
+  }
+  std::ifstream in(argv[1], std::ios::binary);
+  Session session;
+  if (!recording::read_session(in, session)) {
+    std::cerr << "Can't read the recording " << argv[1] << "\n";
+    return 1;
+  }
+  RuleSet rule_set;
+  if (!session.rules.empty()) {
+    std::istringstream rules(session.rules);
+    std::string error;
+    auto set = parse_rule_set(rules, error);
+    if (!set) {
+      std::cerr << "Can't read the rules of " << argv[1] << ", " << error
+                << "\n";
+      return 1;
+    }
+    rule_set = std::move(*set);
+  }
+  width = width > 0 ? width : session.width;
+  height = height > 0 ? height : session.height;
+  if (width < 1 || height < 1 || first < 0 || threads < 1 || threads > 1024 ||
+      level < 0 || level > 9) {
+    return usage();
+  }
+  std::ofstream raw_file;
+  std::ostream *raw = nullptr;
+  if (raw_path == "-") {
+    raw = &std::cout;
+  } else if (!raw_path.empty()) {
+    raw_file.open(raw_path, std::ios::binary | std::ios::trunc);
+    raw = &raw_file;
+  } else {
+    std::filesystem::create_directories(out_dir);
+  }
+
+  Simulation sim(session, rule_set.rules, width, height, particles, nonacid);
+  FrameInput input;
+  GameEvent event;
+  long long frame = 0;
+  long long written = 0;
+  bool more = true;
+  auto t0 = std::chrono::steady_clock::now();
+  // Scenes are simulated in batches, then drawn and encoded by the workers
+  // and written in order.
+  std::vector<Scene> scenes(threads * 4);
+  std::vector<std::string> encoded(scenes.size());
+  while (more && (count < 0 || written < count)) {
+    size_t batch = 0;
+    while (batch < scenes.size() && (count < 0 || written + batch < count)) {
+      auto record = recording::read_record(in, input, event);
+      if (record == recording::Record::end) {
+        more = false;
+        break;
+      }
+      if (record == recording::Record::event) {
+        sim.apply(event);
+        continue;
+      }
+      sim.frame(scenes[batch]);
+      if (frame++ >= first) {
+        batch += 1;
+      }
+    }
+    std::atomic<size_t> next = 0;
+    auto work = [&] {
+      Canvas canvas(width, height);
+      for (size_t k; (k = next++) < batch;) {
+        Draw(scenes[k], nonacid, canvas);
+        if (raw) {
+          auto &pixels = canvas.pixels();
+          encoded[k].assign(pixels.begin(), pixels.end());
+        } else {
+          encoded[k] = EncodePng(canvas, level);
+        }
+      }
+    };
+    std::vector<std::thread> workers;
+    for (unsigned t = 1; t < std::min<size_t>(threads, batch); ++t) {
+      workers.emplace_back(work);
+    }
+    work();
+    for (auto &worker : workers) {
+      worker.join();
+    }
+    for (size_t k = 0; k < batch; ++k, ++written) {
+      if (raw) {
+        raw->write(encoded[k].data(), encoded[k].size());
+      } else {
+        std::ofstream(fmt::format("{}/frame_{:05}.png", out_dir, written),
+                      std::ios::binary | std::ios::trunc)
+            << encoded[k];
+      }
+    }
+    if (raw && !*raw) {
+      std::cerr << "Can't write to " << raw_path << "\n";
+      return 1;
+    }
+  }
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - t0)
+                       .count();
+  std::cerr << fmt::format("{} frames of {}x{} in {:.2f} s, {:.1f} per second\n",
+                           written, width, height, seconds,
+                           written / std::max(seconds, 1e-9));
+  return 0;
+}
@@ -0,0 +1,149 @@
+#include "rule_set.h"
+
+#include <algorithm>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <utility>
+
+namespace {
+
+struct Field {
+  const char *name;
+  int Rules::*member;
+};
+
+constexpr Field fields[] = {
+    {"colors", &Rules::colors},
+    {"magic_odds", &Rules::magic_odds},
+    {"bonus_odds", &Rules::bonus_odds},
+    {"magic_score", &Rules::magic_score},
+    {"bonus_score", &Rules::bonus_score},
+    {"move_limit", &Rules::move_limit},
+    {"line_clear_run", &Rules::line_clear_run},
+    {"blast_run", &Rules::blast_run},
+};
+
+// "row,column" cells up to the end of the line.
+bool parse_pattern(std::istream &line, Pattern &p) {
+  std::string cell;
+  while (line >> cell) {
+    int row, col;
+    char comma;
+    std::istringstream in(cell);
+    if (!(in >> row >> comma >> col) || comma != ',' || !in.eof() ||
+        row < 0 || col < 0 || row > 15 || col > 15) {
+      return false;
+    }
+    p.push_back({row, col});
+  }
+  return p.size() >= 2;
+}
+
+} // namespace
+
+bool validate(const Rules &r, std::string &error) {
+  if (r.colors < 3 || r.colors > 6 || r.magic_odds < 1 || r.bonus_odds < 1 ||
+      r.move_limit < 1 || r.line_clear_run < 0 || r.blast_run < 0) {
+    error = "colors must be 3..6, odds and move_limit positive, run lengths "
+            "not negative";
+    return false;
+  }
+  return true;
+}
+
+std::optional<RuleSet> parse_rule_set(std::istream &in, std::string &error) {
+  RuleSet set;
+  bool own_longs = false;
+  bool own_threes = false;
+  std::string text;
+  for (int number = 1; std::getline(in, text); ++number) {
+    text = text.substr(0, text.find('#'));
+    std::istringstream line(text);
+    std::string key;
+    if (!(line >> key)) {
+      continue;
+    }
+    auto fail = [&](const char *what) {
+      error = "line " + std::to_string(number) + ": " + what;
+      return std::nullopt;
+    };
+    if (key == "long" || key == "three") {
+      bool &own = key == "long" ? own_longs : own_threes;
+      auto &patterns = key == "long" ? set.longs : set.threes;
+      if (!own) {
+        patterns.clear();
+        own = true;
+      }
+      if (!parse_pattern(line, patterns.emplace_back())) {
+        return fail("expected two or more row,column cells within 16x16");
+      }
+      continue;
+    }
+    auto field = std::find_if(std::begin(fields), std::end(fields),
+                              [&](const Field &f) { return key == f.name; });
+    if (field == std::end(fields)) {
+      return fail("unknown key");
+    }
+    std::string rest;
+    if (!(line >> set.rules.*field->member) || line >> rest) {
+      return fail("expected one number");
+    }
+  }
+  if (!validate(set.rules, error)) {
+    return std::nullopt;
+  }
+  return set;
+}
+
+std::optional<RuleSet> load_rule_set(const char *path, std::string &error) {
+  std::ifstream in(path);
+  if (!in) {
+    error = "can't open " + std::string(path);
+    return std::nullopt;
+  }
+  return parse_rule_set(in, error);
+}
+
+std::string format_rule_set(const RuleSet &set) {
+  std::ostringstream out;
+  for (const Field &f : fields) {
+    out << f.name << " " << set.rules.*f.member << "\n";
+  }
+  for (auto [key, patterns] : {std::pair{"long", &set.longs},
+                               std::pair{"three", &set.threes}}) {
+    for (const Pattern &p : *patterns) {
+      out << key;
+      for (const Point &c : p) {
+        out << " " << c.x() << "," << c.y();
+      }
+      out << "\n";
+    }
+  }
+  return out.str();
+}
+
+PatternTable::PatternTable(const std::vector<Pattern> &patterns, int w, int h)
+    : _w{w}, _h{h} {
+  // Symmetric patterns repeat themselves among their rotations and mirrors,
+  // and patterns of a set may be variants of each other.
+  std::set<std::vector<std::pair<int, int>>> seen;
+  for (const Pattern &p : patterns) {
+    for (const SizedPattern &sp : generate(p)) {
+      std::vector<std::pair<int, int>> cells;
+      for (const Point &c : sp.pat) {
+        cells.emplace_back(c.x(), c.y());
+      }
+      std::sort(cells.begin(), cells.end());
+      if (sp.w > w || sp.h > h || !seen.insert(cells).second) {
+        continue;
+      }
+      Shape s{sp.w, sp.h, uint32_t(_offsets.size()), 0};
+      for (const Point &c : sp.pat) {
+        _offsets.push_back(c.x() * h + c.y());
+      }
+      s.end = _offsets.size();
+      _shapes.push_back(s);
+    }
+  }
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+// Rule sets: the Rules of a game and the move patterns its hints look for,
+// read from a text file so that variants can be tried without rebuilding.
+// The default rule set written out in full:
+//
+//   # The rules the game has always been played with.
+//   colors 6
+//   magic_odds 42
+//   bonus_odds 69
+//   magic_score -3
+//   bonus_score 3
+//   move_limit 50
+//   line_clear_run 4
+//   blast_run 5
+//   long 0,0 1,1 0,2 0,3
+//   long 0,0 0,1 1,2 0,3 0,4
+//   long 0,0 1,1 1,2 2,0 3,0
+//   three 0,0 1,1 0,2
+//   three 1,0 0,1 0,2
+//   three 0,0 0,1 0,3
+//
+// Keys left out keep their defaults. The first "long" or "three" line
+// replaces all default patterns of its kind. A pattern is a list of
+// (row, column) cells of the same tile, one swap away from a run; every
+// pattern also counts rotated and mirrored.
+
+#include <cstdint>
+#include <istream>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "board.h"
+
+struct RuleSet {
+  Rules rules;
+  // Placements that a swap turns into a four or five, and into a three.
+  std::vector<Pattern> longs{four_p, five_p_1, five_p_2};
+  std::vector<Pattern> threes{three_p_1, three_p_2, three_p_3};
+};
+
+// Whether the game can be played by these rules; if not, error says why.
+bool validate(const Rules &rules, std::string &error);
+// Reads a rule set. On failure returns nothing and sets error to the line
+// and what is wrong with it.
+std::optional<RuleSet> parse_rule_set(std::istream &in, std::string &error);
+std::optional<RuleSet> load_rule_set(const char *path, std::string &error);
+// The text of a rule set, which parse_rule_set() reads back.
+std::string format_rule_set(const RuleSet &set);
+
+// A set of patterns compiled for boards of one size: every distinct rotation
+// and mirror of every pattern as a list of cell offsets from its top left
+// cell, all in one array. A scan only compares tiles at those offsets.
+class PatternTable {
+  struct Shape {
+    // Rows and columns the shape spans.
+    int rows;
+    int cols;
+    uint32_t begin;
+    uint32_t end;
+  };
+  int _w = 0;
+  int _h = 0;
+  std::vector<Shape> _shapes;
+  std::vector<int> _offsets;
+
+public:
+  PatternTable() = default;
+  PatternTable(const std::vector<Pattern> &patterns, int w, int h);
+  int width() const { return _w; }
+  int height() const { return _h; }
+  size_t shape_count() const { return _shapes.size(); }
+
+  // Calls found(first, last, cell) for every placement of shape k whose
+  // cells hold the same tile, where cell + offsets [first, last) are the
+  // cells. Tiles are row by row, as in Board.
+  template <typename F>
+  void scan(size_t k, const int *tiles, F &&found) const {
+    const Shape &s = _shapes[k];
+    const int *first = _offsets.data() + s.begin;
+    const int *last = _offsets.data() + s.end;
+    for (int i = 0; i + s.rows <= _w; ++i) {
+      for (int j = 0; j + s.cols <= _h; ++j) {
+        const int *t = tiles + i * _h + j;
+        int color = t[first[0]];
+        const int *o = first + 1;
+        while (o != last && t[*o] == color) {
+          ++o;
+        }
+        if (o == last) {
+          found(first, last, i * _h + j);
+        }
+      }
+    }
+  }
+};
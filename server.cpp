@@ -0,0 +1,394 @@
+// Headless game server: hosts many independent games in one process and
+// serves them over a Unix domain socket, so that bots don't pay for process
+// startup and pattern table generation on every game.
+//
+// Usage: tiar2_server <socket path> [workers]
+//
+// Every message is a frame: u32 length of the body, then the body. Integers
+// are little-endian.
+//
+// Request body:  u8 op, u32 session, payload
+// Response body: u8 status, payload
+//
+//   op  name    request payload             response payload
+//   1   NEW     u16 size, u32 seed          u32 session (size 3..max_size)
+//   2   MOVE    u16 row1, col1, row2, col2  u8 accepted
+//   3   SETTLE                              u32 removal steps
+//   4   STATE                               i32 moves, score, normals, longers,
+//                                           longests, crosses, u16 width,
+//                                           u16 height, u8 tiles[w * h],
+//                                           u8 magic[w * h] (1 - magic,
+//                                           2 - bonus)
+//   5   SAVE                                save text, as in save.txt
+//   6   CLOSE
+//
+// Sessions belong to the connection that created them. Every connection is
+// pinned to one worker thread; a worker reads everything that arrived on its
+// connections, handles the whole batch and only then writes the responses.
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <poll.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+#include "game.h"
+
+enum Op : uint8_t {
+  OP_NEW = 1,
+  OP_MOVE = 2,
+  OP_SETTLE = 3,
+  OP_STATE = 4,
+  OP_SAVE = 5,
+  OP_CLOSE = 6,
+};
+
+// Largest board of a NEW request, as for TIAR2_SIZE in the game.
+constexpr int max_size = 4096;
+
+enum Status : uint8_t {
+  STATUS_OK = 0,
+  STATUS_NO_SESSION = 1,
+  STATUS_BAD_REQUEST = 2,
+};
+
+constexpr uint32_t max_frame = 1 << 20;
+
+using AnyGame = std::variant<BasicGame<Board8>, BasicGame<Board10>,
+                             BasicGame<Board16>, BasicGame<Board>>;
+
+std::unique_ptr<AnyGame> make_game(size_t size) {
+  switch (size) {
+  case 8:
+    return std::make_unique<AnyGame>(std::in_place_type<BasicGame<Board8>>, 8);
+  case 10:
+    return std::make_unique<AnyGame>(std::in_place_type<BasicGame<Board10>>,
+                                     10);
+  case 16:
+    return std::make_unique<AnyGame>(std::in_place_type<BasicGame<Board16>>,
+                                     16);
+  default:
+    return std::make_unique<AnyGame>(std::in_place_type<BasicGame<Board>>,
+                                     size);
+  }
+}
+
+class Reader {
+  const char *_p;
+  const char *_end;
+
+public:
+  bool ok = true;
+  Reader(const char *p, const char *end) : _p{p}, _end{end} {}
+  template <typename T> T get() {
+    T v{};
+    if (_end - _p < ptrdiff_t(sizeof(T))) {
+      ok = false;
+      return v;
+    }
+    std::memcpy(&v, _p, sizeof(T));
+    _p += sizeof(T);
+    return v;
+  }
+};
+
+template <typename T> void put(std::string &out, T v) {
+  out.append(reinterpret_cast<const char *>(&v), sizeof(T));
+}
+
+struct Connection {
+  int fd;
+  bool closed = false;
+  std::string in;
+  std::string out;
+  std::unordered_map<uint32_t, std::unique_ptr<AnyGame>> sessions;
+  uint32_t next_session = 1;
+};
+
+// Appends the response to one request to out.
+void handle(Connection &c, const char *p, const char *end, std::string &out) {
+  Reader r(p, end);
+  auto op = r.get<uint8_t>();
+  auto id = r.get<uint32_t>();
+  if (!r.ok) {
+    put(out, STATUS_BAD_REQUEST);
+    return;
+  }
+  if (op == OP_NEW) {
+    auto size = r.get<uint16_t>();
+    auto seed = r.get<uint32_t>();
+    if (!r.ok || size < 3 || size > max_size) {
+      put(out, STATUS_BAD_REQUEST);
+      return;
+    }
+    std::unique_ptr<AnyGame> game;
+    try {
+      game = make_game(size);
+      std::visit(
+          [seed](auto &g) {
+            g.seed(seed);
+            g.new_game();
+          },
+          *game);
+    } catch (const std::bad_alloc &) {
+      put(out, STATUS_BAD_REQUEST);
+      return;
+    }
+    id = c.next_session++;
+    c.sessions.emplace(id, std::move(game));
+    put(out, STATUS_OK);
+    put(out, id);
+    return;
+  }
+  auto it = c.sessions.find(id);
+  if (it == c.sessions.end()) {
+    put(out, STATUS_NO_SESSION);
+    return;
+  }
+  auto &game = *it->second;
+  switch (op) {
+  case OP_MOVE: {
+    int row1 = r.get<uint16_t>();
+    int col1 = r.get<uint16_t>();
+    int row2 = r.get<uint16_t>();
+    int col2 = r.get<uint16_t>();
+    if (!r.ok) {
+      put(out, STATUS_BAD_REQUEST);
+      return;
+    }
+    bool accepted = std::visit(
+        [&](auto &g) {
+          return !g.is_processing() && g.attempt_move(row1, col1, row2, col2);
+        },
+        game);
+    put(out, STATUS_OK);
+    put(out, uint8_t(accepted));
+    break;
+  }
+  case OP_SETTLE: {
+    auto steps = std::visit([](auto &g) { return g.settle(); }, game);
+    put(out, STATUS_OK);
+    put(out, uint32_t(steps));
+    break;
+  }
+  case OP_STATE: {
+    put(out, STATUS_OK);
+    std::visit(
+        [&out](auto &g) {
+          auto &b = g.board();
+          for (int v : {g.counter, b.score, b.normals, b.longers, b.longests,
+                        b.crosses}) {
+            put(out, int32_t(v));
+          }
+          put(out, uint16_t(b.width()));
+          put(out, uint16_t(b.height()));
+          for (int i = 0; i < b.width(); ++i) {
+            for (int j = 0; j < b.height(); ++j) {
+              put(out, uint8_t(b.at(i, j)));
+            }
+          }
+          for (int i = 0; i < b.width(); ++i) {
+            for (int j = 0; j < b.height(); ++j) {
+              put(out, uint8_t(b.is_magic(i, j) | b.is_magic2(i, j) << 1));
+            }
+          }
+        },
+        game);
+    break;
+  }
+  case OP_SAVE: {
+    put(out, STATUS_OK);
+    out += std::visit([](auto &g) { return g.save(); }, game);
+    break;
+  }
+  case OP_CLOSE: {
+    c.sessions.erase(it);
+    put(out, STATUS_OK);
+    break;
+  }
+  default:
+    put(out, STATUS_BAD_REQUEST);
+    break;
+  }
+}
+
+// Handles every complete frame waiting in c.in.
+void handle_batch(Connection &c) {
+  size_t pos = 0;
+  while (c.in.size() - pos >= sizeof(uint32_t)) {
+    uint32_t len;
+    std::memcpy(&len, c.in.data() + pos, sizeof(len));
+    if (len > max_frame) {
+      c.closed = true;
+      return;
+    }
+    if (c.in.size() - pos - sizeof(len) < len) {
+      break;
+    }
+    auto body = c.in.data() + pos + sizeof(len);
+    auto header = c.out.size();
+    put(c.out, uint32_t(0));
+    handle(c, body, body + len, c.out);
+    uint32_t out_len = c.out.size() - header - sizeof(uint32_t);
+    std::memcpy(c.out.data() + header, &out_len, sizeof(out_len));
+    pos += sizeof(len) + len;
+  }
+  c.in.erase(0, pos);
+}
+
+void read_available(Connection &c) {
+  char buf[65536];
+  while (true) {
+    auto n = read(c.fd, buf, sizeof(buf));
+    if (n > 0) {
+      c.in.append(buf, n);
+      continue;
+    }
+    if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+      c.closed = true;
+    }
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    return;
+  }
+}
+
+void write_pending(Connection &c) {
+  while (!c.out.empty()) {
+    auto n = send(c.fd, c.out.data(), c.out.size(), MSG_NOSIGNAL);
+    if (n > 0) {
+      c.out.erase(0, n);
+      continue;
+    }
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+      c.closed = true;
+    }
+    return;
+  }
+}
+
+class Worker {
+  std::mutex _mutex;
+  std::vector<int> _incoming;
+  int _wake[2];
+  std::vector<std::unique_ptr<Connection>> _connections;
+  std::thread _thread;
+
+  void run() {
+    std::vector<pollfd> fds;
+    while (true) {
+      fds.clear();
+      fds.push_back({_wake[0], POLLIN, 0});
+      for (auto &c : _connections) {
+        short events = POLLIN | (c->out.empty() ? 0 : POLLOUT);
+        fds.push_back({c->fd, events, 0});
+      }
+      if (poll(fds.data(), fds.size(), -1) < 0) {
+        continue;
+      }
+      for (size_t k = 1; k < fds.size(); ++k) {
+        if (fds[k].revents & (POLLIN | POLLHUP | POLLERR)) {
+          read_available(*_connections[k - 1]);
+        }
+      }
+      for (auto &c : _connections) {
+        handle_batch(*c);
+        write_pending(*c);
+      }
+      std::erase_if(_connections, [](auto &c) {
+        if (c->closed) {
+          close(c->fd);
+        }
+        return c->closed;
+      });
+      if (fds[0].revents & POLLIN) {
+        char buf[64];
+        while (read(_wake[0], buf, sizeof(buf)) > 0) {
+        }
+        std::lock_guard lock(_mutex);
+        for (int fd : _incoming) {
+          _connections.push_back(std::make_unique<Connection>(fd));
+        }
+        _incoming.clear();
+      }
+    }
+  }
+
+public:
+  Worker() {
+    if (pipe(_wake) == 0) {
+      fcntl(_wake[0], F_SETFL, O_NONBLOCK);
+    }
+    _thread = std::thread([this] { run(); });
+  }
+  void add(int fd) {
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    {
+      std::lock_guard lock(_mutex);
+      _incoming.push_back(fd);
+    }
+    char c = 0;
+    (void)!write(_wake[1], &c, 1);
+  }
+};
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    std::cerr << "Usage: tiar2_server <socket path> [workers]\n";
+    return 1;
+  }
+  std::string path = argv[1];
+  int workers = std::max(1u, std::thread::hardware_concurrency());
+  if (argc > 2) {
+    char *end = nullptr;
+    long n = std::strtol(argv[2], &end, 10);
+    if (*end != '\0' || n < 1 || n > 1024) {
+      std::cerr << "Workers must be 1..1024\n";
+      return 1;
+    }
+    workers = n;
+  }
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr.sun_path)) {
+    std::cerr << "Socket path is too long\n";
+    return 1;
+  }
+  std::strcpy(addr.sun_path, path.c_str());
+  int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  unlink(path.c_str());
+  if (listener < 0 ||
+      bind(listener, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 ||
+      listen(listener, 128) < 0) {
+    std::cerr << "Can't listen on " << path << ": " << std::strerror(errno)
+              << "\n";
+    return 1;
+  }
+  std::vector<std::unique_ptr<Worker>> pool;
+  for (int k = 0; k < workers; ++k) {
+    pool.push_back(std::make_unique<Worker>());
+  }
+  for (size_t next = 0;; next = (next + 1) % pool.size()) {
+    int fd = accept(listener, nullptr, nullptr);
+    if (fd < 0) {
+      continue;
+    }
+    pool[next]->add(fd);
+  }
+}
@@ -0,0 +1,305 @@
+// Differential soak test of the rules engines. Plays random legal moves in
+// many seeded games at once, with every engine side by side on the same
+// random stream:
+//   - ReferenceBoard, the frozen original engine,
+//   - BasicBoard of the same size, compared after every removal step,
+//   - BoardBatch, one board per game, compared after every move,
+// and stops at the first divergence, printing both states. At the end every
+// Board is saved and loaded back, which must give the same state.
+//
+// Usage: tiar2_soak [games] [moves per game] [size] [seed] [budget]
+//
+// With a budget the run also fails if the removal steps of Board make more
+// heap allocations than that on average. Allocations are only counted when
+// built with the allocation tracker.
+
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "alloc_tracker.h"
+#include "batch.h"
+#include "board.h"
+#include "board_io.h"
+#include "reference_board.h"
+
+struct State {
+  int w = 0;
+  int h = 0;
+  std::vector<int> tiles;
+  // 1 - magic, 2 - bonus.
+  std::vector<int> flags;
+  // 1 - swap with the cell below is legal, 2 - with the cell to the right.
+  std::vector<int> legal;
+  std::array<int, 5> counters{};
+};
+
+constexpr const char *counter_names[] = {"score", "normals", "longers",
+                                         "longests", "crosses"};
+
+template <typename B> State state(B &b) {
+  State s{b.width(), b.height()};
+  for (int i = 0; i < s.w; ++i) {
+    for (int j = 0; j < s.h; ++j) {
+      s.tiles.push_back(b.at(i, j));
+      s.flags.push_back(b.is_magic(i, j) | b.is_magic2(i, j) << 1);
+      s.legal.push_back(b.is_legal_swap(i, j, i + 1, j) |
+                        b.is_legal_swap(i, j, i, j + 1) << 1);
+    }
+  }
+  s.counters = {b.score, b.normals, b.longers, b.longests, b.crosses};
+  return s;
+}
+
+State state(const BoardBatch &batch, size_t lane) {
+  State s{batch.width(), batch.height()};
+  for (int i = 0; i < s.w; ++i) {
+    for (int j = 0; j < s.h; ++j) {
+      size_t k = (i * s.h + j) * batch.size() + lane;
+      s.tiles.push_back(batch.at(lane, i, j));
+      s.flags.push_back(batch.magic[k]);
+      s.legal.push_back(batch.legal_moves[k]);
+    }
+  }
+  s.counters = {batch.score[lane], batch.normals[lane], batch.longers[lane],
+                batch.longests[lane], batch.crosses[lane]};
+  return s;
+}
+
+// The first difference between two states, empty if there is none.
+std::string compare(const State &ref, const State &s) {
+  for (int k = 0; k < 5; ++k) {
+    if (ref.counters[k] != s.counters[k]) {
+      return fmt::format("{} {} != {}", counter_names[k], s.counters[k],
+                         ref.counters[k]);
+    }
+  }
+  for (int k = 0; k < ref.w * ref.h; ++k) {
+    int i = k / ref.h;
+    int j = k % ref.h;
+    if (ref.tiles[k] != s.tiles[k]) {
+      return fmt::format("tile ({}, {}) {} != {}", i, j, s.tiles[k],
+                         ref.tiles[k]);
+    }
+    if (ref.flags[k] != s.flags[k]) {
+      return fmt::format("magic flags ({}, {}) {} != {}", i, j, s.flags[k],
+                         ref.flags[k]);
+    }
+    if (ref.legal[k] != s.legal[k]) {
+      return fmt::format("legal swaps ({}, {}) {} != {}", i, j, s.legal[k],
+                         ref.legal[k]);
+    }
+  }
+  return {};
+}
+
+void print(const State &s) {
+  // Tiles, each followed by * for magic, + for bonus or # for both.
+  for (int i = 0; i < s.w; ++i) {
+    for (int j = 0; j < s.h; ++j) {
+      int k = i * s.h + j;
+      std::cerr << s.tiles[k] << " *+#"[s.flags[k]] << " ";
+    }
+    std::cerr << "\n";
+  }
+  std::cerr << fmt::format("score {}, normals {}, longers {}, longests {}, "
+                           "crosses {}\n",
+                           s.counters[0], s.counters[1], s.counters[2],
+                           s.counters[3], s.counters[4]);
+}
+
+// Fails the whole run on the first divergence.
+void check(const State &ref, const State &s, const std::string &engine,
+           const std::string &where) {
+  auto diff = compare(ref, s);
+  if (diff.empty()) {
+    return;
+  }
+  std::cerr << engine << " diverged from the reference " << where << ": "
+            << diff << "\n\nreference:\n";
+  print(ref);
+  std::cerr << "\n" << engine << ":\n";
+  print(s);
+  std::exit(1);
+}
+
+template <typename B>
+int soak(int games, int moves, int size, unsigned seed, double budget) {
+  std::vector<ReferenceBoard> refs;
+  std::vector<B> boards;
+  refs.reserve(games);
+  boards.reserve(games);
+  BoardBatch batch(games, size, size);
+  auto start = [](auto &b, unsigned s) {
+    b.seed(s);
+    b.fill();
+    b.stabilize();
+    b.zero();
+    if (!b.has_any_move()) {
+      b.reshuffle();
+    }
+  };
+  for (int g = 0; g < games; ++g) {
+    start(refs.emplace_back(size, size), seed + g);
+    start(boards.emplace_back(size, size), seed + g);
+    batch.load(g, boards[g]);
+    auto ref = state(refs[g]);
+    auto where = fmt::format("in game {} after the start", seed + g);
+    check(ref, state(boards[g]), "Board", where);
+    check(ref, state(batch, g), "BoardBatch", where);
+  }
+  std::mt19937 pick(seed);
+  std::vector<BatchMove> batch_moves(games);
+  std::vector<std::array<int, 4>> legal;
+  long long played = 0;
+  long long groups = 0;
+  auto t0 = std::chrono::steady_clock::now();
+  for (int m = 0; m < moves; ++m) {
+    for (int g = 0; g < games; ++g) {
+      auto &ref = refs[g];
+      auto &board = boards[g];
+      legal.clear();
+      for (int i = 0; i < size; ++i) {
+        for (int j = 0; j < size; ++j) {
+          if (ref.is_legal_swap(i, j, i + 1, j)) {
+            legal.push_back({i, j, i + 1, j});
+          }
+          if (ref.is_legal_swap(i, j, i, j + 1)) {
+            legal.push_back({i, j, i, j + 1});
+          }
+        }
+      }
+      batch_moves[g] = {};
+      if (legal.empty()) {
+        continue;
+      }
+      auto [i1, j1, i2, j2] = legal[pick() % legal.size()];
+      batch_moves[g] = {int16_t(i1), int16_t(j1), int16_t(i2), int16_t(j2)};
+      ref.swap(i1, j1, i2, j2);
+      board.swap(i1, j1, i2, j2);
+      played += 1;
+      // Removal steps one at a time, the way BasicGame::step() runs them.
+      for (int step = 1;; ++step) {
+        auto where = fmt::format("in game {}, move {} ({}, {}) - ({}, {}), "
+                                 "step {}",
+                                 seed + g, m + 1, i1, j1, i2, j2, step);
+        std::vector<std::tuple<int, int, int>> cells;
+        bool removes;
+        {
+          AllocScope scope("Board step");
+          if (!board.has_removals()) {
+            board.prepare_removals();
+          }
+          removes = board.has_removals();
+          if (removes) {
+            cells = board.remove_one_thing();
+            board.fill_up();
+          }
+        }
+        if (!ref.has_removals()) {
+          ref.prepare_removals();
+        }
+        if (ref.has_removals() != removes) {
+          std::cerr << "Board diverged from the reference " << where
+                    << ": the cascade ended differently\n";
+          std::exit(1);
+        }
+        if (!removes) {
+          break;
+        }
+        if (ref.remove_one_thing() != cells) {
+          std::cerr << "Board diverged from the reference " << where
+                    << ": removed a different group\n";
+          std::exit(1);
+        }
+        ref.fill_up();
+        groups += 1;
+        check(state(ref), state(board), "Board", where);
+      }
+      if (!ref.has_any_move()) {
+        ref.reshuffle();
+      }
+      if (!board.has_any_move()) {
+        board.reshuffle();
+      }
+      check(state(ref), state(board), "Board",
+            fmt::format("in game {}, move {}, after the cascade", seed + g,
+                        m + 1));
+    }
+    {
+      AllocScope scope("BoardBatch step");
+      batch.step(batch_moves.data());
+    }
+    for (int g = 0; g < games; ++g) {
+      check(state(refs[g]), state(batch, g), "BoardBatch",
+            fmt::format("in game {}, move {}", seed + g, m + 1));
+    }
+    if ((m + 1) % 100 == 0 || m + 1 == moves) {
+      std::chrono::duration<double> t = std::chrono::steady_clock::now() - t0;
+      std::cout << fmt::format("{} moves, {} removal steps, no divergence "
+                               "({:.1f} s)\n",
+                               played, groups, t.count());
+    }
+  }
+  for (int g = 0; g < games; ++g) {
+    std::stringstream save;
+    save << boards[g];
+    B loaded(size, size);
+    save >> loaded;
+    check(state(boards[g]), state(loaded), "Loaded save",
+          fmt::format("in game {} after {} moves", seed + g, moves));
+  }
+  if (!alloc_tracking) {
+    return 0;
+  }
+  for (const char *name : {"Board step", "BoardBatch step"}) {
+    AllocTag tag = alloc_tag(name);
+    std::cout << fmt::format("{}: {:.2f} allocations, {:.0f} B per call, "
+                             "worst {} ({} B)\n",
+                             name, double(tag.total.count) / tag.calls,
+                             double(tag.total.bytes) / tag.calls,
+                             tag.peak.count, tag.peak.bytes);
+  }
+  AllocTag steps = alloc_tag("Board step");
+  if (budget >= 0 && steps.calls &&
+      double(steps.total.count) / steps.calls > budget) {
+    std::cerr << fmt::format("Board removal steps went over the budget of "
+                             "{} allocations\n",
+                             budget);
+    return 1;
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  int games = argc > 1 ? std::stoi(argv[1]) : 1000;
+  int moves = argc > 2 ? std::stoi(argv[2]) : 1000;
+  int size = argc > 3 ? std::stoi(argv[3]) : 8;
+  unsigned seed = argc > 4 ? std::stoul(argv[4]) : std::random_device{}();
+  double budget = argc > 5 ? std::stod(argv[5]) : -1;
+  if (games < 1 || moves < 0 || size < 3 || size > 255) {
+    std::cerr << "Usage: tiar2_soak [games] [moves per game] [size] [seed] "
+                 "[budget]\n";
+    return 1;
+  }
+  std::cout << fmt::format("{} games of {}x{}, seeds {}..{}, kernels: {}\n",
+                           games, size, size, seed, seed + games - 1,
+                           lane_kernels().isa);
+  switch (size) {
+  case 8:
+    return soak<Board8>(games, moves, size, seed, budget);
+  case 10:
+    return soak<Board10>(games, moves, size, seed, budget);
+  case 16:
+    return soak<Board16>(games, moves, size, seed, budget);
+  default:
+    return soak<Board>(games, moves, size, seed, budget);
+  }
+}
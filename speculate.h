@@ -0,0 +1,142 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "board.h"
+
+// The first removal step of a swap, found before the swap is played.
+struct Speculation {
+  // Of the board before the swap.
+  uint64_t hash = 0;
+  std::array<int, 4> move{};
+  Removals removals;
+  // Cells of the first group, as (row, column).
+  std::vector<std::pair<int, int>> cells;
+
+  bool is_for(uint64_t h, int row1, int col1, int row2, int col2) const {
+    return hash == h && (move == std::array{row1, col1, row2, col2} ||
+                         move == std::array{row2, col2, row1, col1});
+  }
+};
+
+// Plays the swap the player is aiming at on a copy of the board, on a
+// background thread, and keeps what prepare_removals() finds. A click on that
+// swap then hands the result to the game instead of scanning the board, and
+// the first group can be shown before the click. A new request cancels the
+// one in progress; results are published whole.
+template <typename B> class SwapSpeculator {
+  std::mutex _mutex;
+  std::condition_variable _cv;
+  std::optional<B> _job;
+  std::array<int, 4> _job_move{};
+  bool _stop = false;
+  uint64_t _requested = 0;
+  std::array<int, 4> _requested_move{};
+  std::atomic<uint64_t> _generation = 0;
+  std::atomic<std::shared_ptr<Speculation>> _latest;
+  std::thread _thread;
+
+  void run() {
+    std::unique_lock lock(_mutex);
+    while (true) {
+      _cv.wait(lock, [this] { return _stop || _job; });
+      if (_stop) {
+        return;
+      }
+      B board = std::move(*_job);
+      _job.reset();
+      auto [row1, col1, row2, col2] = _job_move;
+      uint64_t generation = _generation;
+      lock.unlock();
+      auto spec = std::make_shared<Speculation>();
+      spec->hash = board.hash();
+      spec->move = {row1, col1, row2, col2};
+      board.swap(row1, col1, row2, col2);
+      if (_generation == generation) {
+        board.prepare_removals();
+        spec->cells = board.next_removal();
+        spec->removals = board.take_removals();
+        if (_generation == generation) {
+          _latest = std::move(spec);
+        }
+      }
+      lock.lock();
+    }
+  }
+
+public:
+  SwapSpeculator() : _thread{[this] { run(); }} {}
+  ~SwapSpeculator() {
+    {
+      std::lock_guard lock(_mutex);
+      _stop = true;
+    }
+    _cv.notify_all();
+    _thread.join();
+  }
+  // Starts working out the swap on b, unless it is already known or being
+  // worked out.
+  void request(const B &b, int row1, int col1, int row2, int col2) {
+    uint64_t hash = b.hash();
+    std::array move{row1, col1, row2, col2};
+    auto latest = _latest.load();
+    if ((hash == _requested && move == _requested_move) ||
+        (latest && latest->is_for(hash, row1, col1, row2, col2))) {
+      return;
+    }
+    B copy = b;
+    {
+      std::lock_guard lock(_mutex);
+      _job = std::move(copy);
+      _job_move = move;
+      _requested = hash;
+      _requested_move = move;
+      _generation += 1;
+      _latest.store(nullptr);
+    }
+    _cv.notify_all();
+  }
+  // Drops the request in progress and the published result.
+  void cancel() {
+    if (_requested == 0 && !_latest.load()) {
+      return;
+    }
+    {
+      std::lock_guard lock(_mutex);
+      _job.reset();
+      _requested = 0;
+      _generation += 1;
+      _latest.store(nullptr);
+    }
+  }
+  // The newest published result, for whatever swap it was made.
+  std::shared_ptr<const Speculation> latest() const { return _latest.load(); }
+  // Whether a request is still waiting for its result.
+  bool pending() const {
+    auto latest = _latest.load();
+    return _requested != 0 &&
+           !(latest && latest->hash == _requested &&
+             latest->move == _requested_move);
+  }
+  // The removals of that swap on b, if they are known. They can be taken
+  // once.
+  std::optional<Removals> take(const B &b, int row1, int col1, int row2,
+                               int col2) {
+    auto latest = _latest.load();
+    if (!latest || !latest->is_for(b.hash(), row1, col1, row2, col2)) {
+      return std::nullopt;
+    }
+    _latest.store(nullptr);
+    _requested = 0;
+    return std::move(latest->removals);
+  }
+};
@@ -0,0 +1,96 @@
+/* Plain C interface to the Tiar2 rules, for bots and training scripts in
+ * other languages. Boards are opaque handles; nothing here depends on raylib
+ * or iostreams.
+ *
+ * Coordinates are (row, column), row 0 at the top; tiles fall towards
+ * larger rows. Tile values are 1..6, magic flags are 1 for a magic tile
+ * (-3 points when removed) and 2 for a bonus tile (+3 points). */
+
+#ifndef TIAR2_H
+#define TIAR2_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+#if defined(TIAR2_BUILDING)
+#define TIAR2_API __declspec(dllexport)
+#else
+#define TIAR2_API __declspec(dllimport)
+#endif
+#else
+#define TIAR2_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TIAR2_ABI_VERSION 1
+/* Boards are at most this many rows and columns. */
+#define TIAR2_MAX_SIZE 4096
+
+typedef struct tiar2_board tiar2_board;
+
+typedef struct tiar2_counters {
+  int32_t score;
+  int32_t normals;
+  int32_t longers;
+  int32_t longests;
+  int32_t crosses;
+} tiar2_counters;
+
+/* Returns TIAR2_ABI_VERSION of the library actually loaded. */
+TIAR2_API uint32_t tiar2_abi_version(void);
+
+/* Returns NULL if width or height is below 3 or above TIAR2_MAX_SIZE, or
+ * memory runs out. */
+TIAR2_API tiar2_board *tiar2_board_create(int32_t width, int32_t height);
+TIAR2_API void tiar2_board_destroy(tiar2_board *board);
+TIAR2_API void tiar2_board_seed(tiar2_board *board, uint32_t seed);
+TIAR2_API int32_t tiar2_board_width(const tiar2_board *board);
+TIAR2_API int32_t tiar2_board_height(const tiar2_board *board);
+
+/* Fills every cell with a random tile. */
+TIAR2_API void tiar2_board_fill(tiar2_board *board);
+/* Removes runs and refills until none are left; points scored on the way
+ * are counted. */
+TIAR2_API void tiar2_board_stabilize(tiar2_board *board);
+/* Fills the board with random tiles without any runs, in one pass, and
+ * clears magic flags. Nothing is scored. If ensure_move is nonzero, boards
+ * without a legal swap are thrown away and made again; returns 0 if none
+ * of 1000 had one, which only happens on the smallest boards, else 1. */
+TIAR2_API int32_t tiar2_board_generate(tiar2_board *board,
+                                       int32_t ensure_move);
+TIAR2_API void tiar2_board_reset_counters(tiar2_board *board);
+
+TIAR2_API int32_t tiar2_board_is_legal_swap(const tiar2_board *board,
+                                            int32_t row1, int32_t col1,
+                                            int32_t row2, int32_t col2);
+TIAR2_API int32_t tiar2_board_has_any_move(const tiar2_board *board);
+/* Swaps two tiles if that creates a run. Returns 1 if the swap was made, 0
+ * if it was illegal and the board is unchanged. */
+TIAR2_API int32_t tiar2_board_swap(tiar2_board *board, int32_t row1,
+                                   int32_t col1, int32_t row2, int32_t col2);
+/* Runs the cascade started by a swap to the end and returns the number of
+ * removed groups. A board left without legal moves is reshuffled; if no
+ * arrangement of its tiles has one, it keeps them and
+ * tiar2_board_has_any_move() returns 0. */
+TIAR2_API int32_t tiar2_board_settle(tiar2_board *board);
+
+/* Copy width * height row-major values into buffer. Return the number of
+ * cells copied, or -1 if the buffer is too small. */
+TIAR2_API int32_t tiar2_board_read_tiles(const tiar2_board *board,
+                                         uint8_t *buffer, size_t size);
+TIAR2_API int32_t tiar2_board_read_magic(const tiar2_board *board,
+                                         uint8_t *buffer, size_t size);
+TIAR2_API void tiar2_board_read_counters(const tiar2_board *board,
+                                         tiar2_counters *counters);
+/* Zobrist hash of the tiles and magic flags. */
+TIAR2_API uint64_t tiar2_board_hash(const tiar2_board *board);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,156 @@
+#define TIAR2_BUILDING
+#include "tiar2.h"
+
+#include <new>
+#include <variant>
+
+#include "board.h"
+
+struct tiar2_board {
+  std::variant<Board8, Board10, Board16, Board> board;
+};
+
+namespace {
+
+template <typename B, typename... Args> tiar2_board *make(Args... args) {
+  return new (std::nothrow) tiar2_board{
+      decltype(tiar2_board::board)(std::in_place_type<B>, args...)};
+}
+
+tiar2_board *make_board(int32_t width, int32_t height) {
+  if (width == 8 && height == 8) {
+    return make<Board8>();
+  }
+  if (width == 10 && height == 10) {
+    return make<Board10>();
+  }
+  if (width == 16 && height == 16) {
+    return make<Board16>();
+  }
+  return make<Board>(size_t(width), size_t(height));
+}
+
+template <typename F> auto visit(const tiar2_board *board, F f) {
+  return std::visit(f, board->board);
+}
+
+template <typename F> auto visit(tiar2_board *board, F f) {
+  return std::visit(f, board->board);
+}
+
+template <typename F>
+int32_t read_cells(const tiar2_board *board, size_t size, F f) {
+  return visit(board, [&](auto &b) {
+    size_t cells = size_t(b.width()) * b.height();
+    if (size < cells) {
+      return -1;
+    }
+    for (int i = 0; i < b.width(); ++i) {
+      for (int j = 0; j < b.height(); ++j) {
+        f(i * b.height() + j, b, i, j);
+      }
+    }
+    return int32_t(cells);
+  });
+}
+
+} // namespace
+
+extern "C" {
+
+uint32_t tiar2_abi_version(void) { return TIAR2_ABI_VERSION; }
+
+tiar2_board *tiar2_board_create(int32_t width, int32_t height) {
+  if (width < 3 || height < 3 || width > TIAR2_MAX_SIZE ||
+      height > TIAR2_MAX_SIZE) {
+    return nullptr;
+  }
+  try {
+    return make_board(width, height);
+  } catch (const std::bad_alloc &) {
+    return nullptr;
+  }
+}
+
+void tiar2_board_destroy(tiar2_board *board) { delete board; }
+
+void tiar2_board_seed(tiar2_board *board, uint32_t seed) {
+  visit(board, [seed](auto &b) { b.seed(seed); });
+}
+
+int32_t tiar2_board_width(const tiar2_board *board) {
+  return visit(board, [](auto &b) { return b.width(); });
+}
+
+int32_t tiar2_board_height(const tiar2_board *board) {
+  return visit(board, [](auto &b) { return b.height(); });
+}
+
+void tiar2_board_fill(tiar2_board *board) {
+  visit(board, [](auto &b) { b.fill(); });
+}
+
+void tiar2_board_stabilize(tiar2_board *board) {
+  visit(board, [](auto &b) { b.stabilize(); });
+}
+
+int32_t tiar2_board_generate(tiar2_board *board, int32_t ensure_move) {
+  return visit(board,
+               [ensure_move](auto &b) { return b.generate(ensure_move != 0); });
+}
+
+void tiar2_board_reset_counters(tiar2_board *board) {
+  visit(board, [](auto &b) { b.zero(); });
+}
+
+int32_t tiar2_board_is_legal_swap(const tiar2_board *board, int32_t row1,
+                                  int32_t col1, int32_t row2, int32_t col2) {
+  return visit(board, [&](auto &b) {
+    return b.is_legal_swap(row1, col1, row2, col2);
+  });
+}
+
+int32_t tiar2_board_has_any_move(const tiar2_board *board) {
+  return visit(board, [](auto &b) { return b.has_any_move(); });
+}
+
+int32_t tiar2_board_swap(tiar2_board *board, int32_t row1, int32_t col1,
+                         int32_t row2, int32_t col2) {
+  return visit(board, [&](auto &b) {
+    if (!b.is_legal_swap(row1, col1, row2, col2)) {
+      return 0;
+    }
+    b.swap(row1, col1, row2, col2);
+    return 1;
+  });
+}
+
+int32_t tiar2_board_settle(tiar2_board *board) {
+  return visit(board, [](auto &b) { return b.settle(); });
+}
+
+int32_t tiar2_board_read_tiles(const tiar2_board *board, uint8_t *buffer,
+                               size_t size) {
+  return read_cells(board, size, [buffer](int k, auto &b, int i, int j) {
+    buffer[k] = uint8_t(b.at(i, j));
+  });
+}
+
+int32_t tiar2_board_read_magic(const tiar2_board *board, uint8_t *buffer,
+                               size_t size) {
+  return read_cells(board, size, [buffer](int k, auto &b, int i, int j) {
+    buffer[k] = uint8_t(b.is_magic(i, j) | b.is_magic2(i, j) << 1);
+  });
+}
+
+void tiar2_board_read_counters(const tiar2_board *board,
+                               tiar2_counters *counters) {
+  visit(board, [counters](auto &b) {
+    *counters = {b.score, b.normals, b.longers, b.longests, b.crosses};
+  });
+}
+
+uint64_t tiar2_board_hash(const tiar2_board *board) {
+  return visit(board, [](auto &b) { return b.hash(); });
+}
+}